@@ -3,6 +3,7 @@
 
 #include "gon.h"
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -71,6 +72,7 @@ typedef struct
     int current_list_depth;
 
     _Bool error;
+    GON_Error *report; // optional, the first failure is recorded here
 } GON_State;
 
 static GON_Str span(char *beg, char *end)
@@ -127,6 +129,24 @@ static void *alloc(GON_Linear_Allocator *a, ptrdiff_t count, ptrdiff_t size, ptr
     return memset(r, 0, count*size);
 }
 
+static void gon_report(GON_State *state, GON_Error_Code code, char *expected, GON_Str found)
+{
+    if (state->report && !state->report->code)
+    {
+        state->report->code       = code;
+        state->report->offset     = found.data ? found.data - state->source : state->source_len;
+        state->report->expected   = expected;
+        state->report->found.data = found.data;
+        state->report->found.len  = found.len;
+    }
+}
+
+static void gon_fail(GON_State *state, GON_Error_Code code, char *expected, GON_Str found)
+{
+    state->error = 1;
+    gon_report(state, code, expected, found);
+}
+
 #ifndef GON_IGNORE_STD_ALLOC
 static void *gon_std_malloc(ptrdiff_t size, void *ctx)
 {
@@ -258,7 +278,14 @@ static GON_Token_Result gon_next_token(GON_State *state)
 
                 state->current = substring(state->current, 1);
             }
-            state->current = substring(state->current, 1);
+            if (state->current.len > 0)
+            {
+                state->current = substring(state->current, 1);
+            }
+            else
+            {
+                gon_fail(state, GON_Error_Unterminated_String, "a closing '\"'", U(result.token.str.data - 1, 1));
+            }
             break;
         default:
             type = GON_Token_Ident;
@@ -325,9 +352,8 @@ static GON_Single_Result gon_next_object(GON_State *state)
                 }
                 else
                 {
-                // todo bounds checking
                     result.success = 0;
-                    state->error = 1;
+                    gon_fail(state, GON_Error_Too_Deep, "lists nested at most GON_MAX_SUB_OBJECT_DEPTH deep", current.str);
                 }
             }
             break;
@@ -361,7 +387,7 @@ static GON_Single_Result gon_next_object(GON_State *state)
             }
             else
             {
-                state->error = 1;
+                gon_fail(state, GON_Error_Too_Deep, "lists nested at most GON_MAX_SUB_OBJECT_DEPTH deep", current.str);
             }
             break;
         }
@@ -385,6 +411,10 @@ static GON_Single_Result gon_next_object(GON_State *state)
                     gon_next_token(state);
                 }
             }
+            else
+            {
+                gon_fail(state, GON_Error_Unexpected_Token, "a name or '}'", current.str);
+            }
             break;
         }
         case GON_Token_Ident: {
@@ -430,22 +460,33 @@ static GON_Single_Result gon_next_object(GON_State *state)
                         }
                         else
                         {
-                            state->error = 1;
+                            gon_fail(state, GON_Error_Too_Deep, "lists nested at most GON_MAX_SUB_OBJECT_DEPTH deep", context.str);
                         }
                         break;
                     case GON_Token_Ident:
                         user->type  = GON_Widget;
                         user->value = R(user->value, context.str);
+                        if (context.is_string)
+                        {
+                            user->subtype |= GON_Subtype_Value_String;
+                        }
                         break;
                     default:
-                        //assert(0);
+                        gon_fail(state, GON_Error_Unexpected_Token, "a value, '{' or '['", context.str);
                         break;
                     }
                 }
             }
+            else
+            {
+                gon_fail(state, GON_Error_Unexpected_Token,
+                         state->in_list_depth[state->current_list_depth] ? "',' or ']'" : "a value, '{' or '['",
+                         peek.str);
+            }
             break;
         }
         case GON_Token_Colon: {
+            gon_fail(state, GON_Error_Unexpected_Token, "a name", current.str);
             break;
         }
         case GON_Token_Comma: {
@@ -474,6 +515,9 @@ static GON_Results gon_objects(GON_State *base_state, GON_Linear_Allocator *aren
     int num_top_level_objects = 0;
     int num_non_terminator_objects = 0;
 
+    // Every pass below copies base_state, so they all report into the result
+    base_state->report = &result.error;
+
     GON_State state = *base_state;
     GON_Single_Result raw_result = {0};
     int scope = 0;
@@ -488,14 +532,20 @@ static GON_Results gon_objects(GON_State *base_state, GON_Linear_Allocator *aren
 
         if (scope == 0)
         {
-            num_top_level_objects += 1;
             switch (object.type)
             {
             case GON_Block:
             case GON_List:
                 scope += 1;
+                num_top_level_objects += 1;
+                break;
+            case GON_Block_End:
+            case GON_List_End:
+                // Recorded without stopping so the layout below sees the same objects as before
+                gon_report(&state, GON_Error_Unbalanced, "a name", U(object.name.data, object.name.len));
                 break;
             default:
+                num_top_level_objects += 1;
                 break;
             }
         }
@@ -517,6 +567,11 @@ static GON_Results gon_objects(GON_State *base_state, GON_Linear_Allocator *aren
         }
     }
 
+    if (scope > 0)
+    {
+        gon_report(&state, GON_Error_Unbalanced, "'}' or ']'", U(0, 0));
+    }
+
     /*    Add blocks and their children to buffer `final`.
      *    The resulting memory layout looks something like this:
 
@@ -669,6 +724,9 @@ static GON_Results gon_objects(GON_State *base_state, GON_Linear_Allocator *aren
         GON_Object *final = new(arena, GON_Object, num_non_terminator_objects);
         GON_Object *current = final;
 
+        // Malformed input can re-scan differently than it counted, never write past `final`
+        GON_Object *final_end = final + num_non_terminator_objects;
+
         state = *base_state;
         scope = 0;
 
@@ -676,16 +734,17 @@ static GON_Results gon_objects(GON_State *base_state, GON_Linear_Allocator *aren
         int num_appended = 0;
         while ((raw_result = gon_next_object(&state)).success) {
             GON_Object object = raw_result.result;
-            if (scope == 0 && object.type != GON_Block_End)
+            if (scope == 0 && object.type != GON_Block_End && object.type != GON_List_End && current < final_end)
             {
                 *current = object;
                 current++;
                 num_appended += 1;
             }
 
+            // Stray terminators at the top level were reported above and close nothing
             if (object.type == GON_Block || object.type == GON_List) {
                 scope += 1;
-            } else if (object.type == GON_Block_End || object.type == GON_List_End) {
+            } else if ((object.type == GON_Block_End || object.type == GON_List_End) && scope > 0) {
                 scope -= 1;
             }
         }
@@ -714,7 +773,7 @@ static GON_Results gon_objects(GON_State *base_state, GON_Linear_Allocator *aren
                 while (scope > 0 && (raw_result = gon_next_object(&state)).success) {
                     GON_Object object = raw_result.result;
 
-                    if (scope == 1 && object.type != GON_Block_End && object.type != GON_List_End) {
+                    if (scope == 1 && object.type != GON_Block_End && object.type != GON_List_End && current < final_end) {
                         if (parent->children_len == 0) {
                             parent->children = current;
                         }
@@ -735,7 +794,7 @@ static GON_Results gon_objects(GON_State *base_state, GON_Linear_Allocator *aren
         result.results = final;
         result.top_level_results_len = num_top_level_objects;
         result.all_results_len = num_non_terminator_objects;
-        result.ok = 1;
+        result.ok = !result.error.code;
     }
 
     return result;
@@ -796,22 +855,7 @@ GON_API GON_Results gon_load(char *source)
 GON_API GON_Results gon_load2(char *source, ptrdiff_t source_len)
 {
     GON_Allocator allocator = gon_get_stdlib_allocator();
-    ptrdiff_t cap = sizeof(GON_Object) * (1 + gon_object_count2(source, source_len));
-    char *mem = allocator.malloc(cap, allocator.ctx);
-    GON_Linear_Allocator perm = {0};
-    perm.beg = mem;
-    perm.end = mem + cap;
-
-    GON_State state = {0};
-    state.source = source;
-    state.source_len = source_len;
-    state.current.data = source;
-    state.current.len  = source_len;
-
-    GON_Results results = gon_objects(&state, &perm);
-    results.free_this = mem;
-    results.free_this_size = cap;
-    return results;
+    return gon_load3(source, source_len, &allocator);
 }
 
 GON_API GON_Results gon_load3(char *source, ptrdiff_t source_len, GON_Allocator *allocator)
@@ -828,7 +872,10 @@ GON_API GON_Results gon_load3(char *source, ptrdiff_t source_len, GON_Allocator
     state.current.data = source;
     state.current.len  = source_len;
 
-    return gon_objects(&state, &perm);
+    GON_Results results = gon_objects(&state, &perm);
+    results.free_this = mem;
+    results.free_this_size = cap;
+    return results;
 }
 
 GON_API int gon_children_total(GON_Object object)
@@ -900,6 +947,806 @@ GON_API void gon_free1(GON_Results results, GON_Allocator alloc)
     alloc.free(results.free_this, alloc.ctx);
 }
 
+/* Error reporting */
+
+// Only runs once something already went wrong, so it is free to re-scan the source.
+GON_API GON_Error_Location gon_error_location(char *source, ptrdiff_t source_len, GON_Error error)
+{
+    GON_Error_Location location = {0};
+    if (error.offset > source_len)
+    {
+        error.offset = source_len;
+    }
+
+    // Line and column
+    char *line_start = source;
+    char *error_at   = source + error.offset;
+    location.line = 1;
+    for (char *at = source; at < error_at; )
+    {
+        char *newline = memchr(at, '\n', error_at - at);
+        if (!newline)
+        {
+            break;
+        }
+        location.line += 1;
+        line_start = at = newline + 1;
+    }
+    location.column = (int) (error_at - line_start) + 1;
+
+    char *source_end = source + source_len;
+    char *line_end   = memchr(line_start, '\n', source_end - line_start);
+    location.line_text.data = line_start;
+    location.line_text.len  = (line_end ? line_end : source_end) - line_start;
+
+    // Nesting path: replay the parser up to the failure, tracking open blocks and lists
+    struct {
+        GON_Str name;
+        int index;       // position within the parent
+        _Bool in_list;   // parent was a list, so print the index
+        int children;
+    } stack[32];
+    int depth = 0;
+    int top_level_children = 0;
+
+    GON_State state = {0};
+    state.source = source;
+    state.source_len = source_len;
+    state.current = U(source, source_len);
+
+    GON_Single_Result raw_result;
+    while ((raw_result = gon_next_object(&state)).success)
+    {
+        GON_Object object = raw_result.result;
+        if (object.name.data && object.name.data - source >= error.offset)
+        {
+            break;
+        }
+
+        if (object.type == GON_Block_End || object.type == GON_List_End)
+        {
+            if (depth > 0)
+            {
+                depth -= 1;
+            }
+            continue;
+        }
+
+        int *children = depth ? &stack[depth - 1].children : &top_level_children;
+        int index = (*children)++;
+
+        if ((object.type == GON_Block || object.type == GON_List) && depth < (int) (sizeof(stack) / sizeof(stack[0])))
+        {
+            stack[depth].name     = U(object.name.data, object.name.len);
+            stack[depth].index    = index;
+            stack[depth].in_list  = (object.subtype & GON_Subtype_List_Item) != 0;
+            stack[depth].children = 0;
+            depth += 1;
+        }
+    }
+
+    int len = 0;
+    int cap = (int) sizeof(location.path);
+    for (int i = 0; i < depth && len < cap; i++)
+    {
+        if (stack[i].in_list)
+        {
+            len += snprintf(location.path + len, cap - len, "[%d]", stack[i].index);
+        }
+        else
+        {
+            len += snprintf(location.path + len, cap - len, "%s%.*s", i ? "." : "", (int) stack[i].name.len, stack[i].name.data);
+        }
+    }
+
+    return location;
+}
+
+GON_API int gon_error_format(char *source, ptrdiff_t source_len, GON_Error error, char *buf, int buf_len)
+{
+    GON_Error_Location location = gon_error_location(source, source_len, error);
+
+    char *found_prefix = error.found.len ? "'" : "end of input";
+    char *found_suffix = error.found.len ? "'" : "";
+
+    return snprintf(buf, buf_len, "%d:%d: expected %s, found %s%.*s%s%s%s",
+                    location.line, location.column,
+                    error.expected ? error.expected : "valid GON",
+                    found_prefix, (int) error.found.len, error.found.data, found_suffix,
+                    location.path[0] ? " in " : "", location.path);
+}
+
+/* JSON interop */
+
+#if !defined(GON_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define GON_SIMD_SSE2
+#include <emmintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#endif
+
+// Bounds how deep JSON objects and arrays may nest. Unlike GON lists this only
+// sizes the validation stack, the breadth-first layout itself has no depth limit.
+#ifndef GON_JSON_MAX_DEPTH
+#define GON_JSON_MAX_DEPTH 256
+#endif
+
+typedef struct
+{
+    char *buf; // null while measuring
+    ptrdiff_t len;
+} GON_Json_Writer;
+
+#ifdef GON_SIMD_SSE2
+static int gon_ctz(unsigned int mask)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int) index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+static char *gon_json_skip_whitespace(char *at, char *end)
+{
+    while (at < end && (*at == ' ' || *at == '\n' || *at == '\r' || *at == '\t'))
+    {
+        at++;
+    }
+    return at;
+}
+
+// `at` points just past an opening quote. Returns the closing quote, or `end`.
+static char *gon_json_string_end(char *at, char *end)
+{
+    for (;;)
+    {
+#ifdef GON_SIMD_SSE2
+        __m128i quote = _mm_set1_epi8('"');
+        __m128i slash = _mm_set1_epi8('\\');
+        while (end - at >= 16)
+        {
+            __m128i chunk = _mm_loadu_si128((__m128i *) at);
+            int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                                      _mm_cmpeq_epi8(chunk, slash)));
+            if (mask)
+            {
+                at += gon_ctz(mask);
+                break;
+            }
+            at += 16;
+        }
+#endif
+        while (at < end && *at != '"' && *at != '\\')
+        {
+            at++;
+        }
+
+        if (at >= end || *at == '"')
+        {
+            return at;
+        }
+
+        // Step over the backslash and the character it escapes
+        if (end - at < 2)
+        {
+            return end;
+        }
+        at += 2;
+    }
+}
+
+// `at` points at an opening bracket. Returns one past its matching close, or `end`.
+// Assumes the input was already validated by gon_json_count.
+static char *gon_json_container_end(char *at, char *end)
+{
+    int depth = 0;
+    while (at < end)
+    {
+#ifdef GON_SIMD_SSE2
+        __m128i quote = _mm_set1_epi8('"');
+        __m128i curly = _mm_set1_epi8('{');
+        __m128i curly_end = _mm_set1_epi8('}');
+        __m128i square = _mm_set1_epi8('[');
+        __m128i square_end = _mm_set1_epi8(']');
+        while (end - at >= 16)
+        {
+            __m128i chunk = _mm_loadu_si128((__m128i *) at);
+            __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                                     _mm_cmpeq_epi8(chunk, curly)),
+                                        _mm_or_si128(_mm_cmpeq_epi8(chunk, curly_end),
+                                                     _mm_or_si128(_mm_cmpeq_epi8(chunk, square),
+                                                                  _mm_cmpeq_epi8(chunk, square_end))));
+            int mask = _mm_movemask_epi8(hits);
+            if (mask)
+            {
+                at += gon_ctz(mask);
+                break;
+            }
+            at += 16;
+        }
+#endif
+        while (at < end && *at != '"' && *at != '{' && *at != '}' && *at != '[' && *at != ']')
+        {
+            at++;
+        }
+
+        if (at >= end)
+        {
+            break;
+        }
+
+        char c = *at++;
+        if (c == '"')
+        {
+            at = gon_json_string_end(at, end);
+            if (at < end)
+            {
+                at++;
+            }
+        }
+        else if (c == '{' || c == '[')
+        {
+            depth += 1;
+        }
+        else if (--depth == 0)
+        {
+            return at;
+        }
+    }
+    return end;
+}
+
+static char *gon_json_scalar_end(char *at, char *end)
+{
+    while (at < end &&
+           *at != ',' && *at != '}' && *at != ']' && *at != ':' &&
+           *at != ' ' && *at != '\n' && *at != '\r' && *at != '\t')
+    {
+        at++;
+    }
+    return at;
+}
+
+static _Bool gon_json_is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// true, false, null or a number as spelled by the JSON grammar
+static _Bool gon_json_valid_scalar(GON_Str s)
+{
+    if (equals(s, S("true")) || equals(s, S("false")) || equals(s, S("null")))
+    {
+        return 1;
+    }
+
+    char *at  = s.data;
+    char *end = s.data + s.len;
+
+    if (at < end && *at == '-') at++;
+    if (at >= end) return 0;
+
+    if (*at == '0')
+    {
+        at++;
+    }
+    else if (gon_json_is_digit(*at))
+    {
+        while (at < end && gon_json_is_digit(*at)) at++;
+    }
+    else
+    {
+        return 0;
+    }
+
+    if (at < end && *at == '.')
+    {
+        at++;
+        if (at >= end || !gon_json_is_digit(*at)) return 0;
+        while (at < end && gon_json_is_digit(*at)) at++;
+    }
+
+    if (at < end && (*at == 'e' || *at == 'E'))
+    {
+        at++;
+        if (at < end && (*at == '+' || *at == '-')) at++;
+        if (at >= end || !gon_json_is_digit(*at)) return 0;
+        while (at < end && gon_json_is_digit(*at)) at++;
+    }
+
+    return at == end;
+}
+
+// Validates the whole document and counts every value in it, including the
+// document itself. Returns -1 on malformed input.
+static int gon_json_count(char *source, ptrdiff_t source_len)
+{
+    char stack[GON_JSON_MAX_DEPTH];
+    int depth = 0;
+    int count = 0;
+
+    char *at  = source;
+    char *end = source + source_len;
+    _Bool expect_value = 1;
+
+    for (;;)
+    {
+        at = gon_json_skip_whitespace(at, end);
+
+        if (expect_value)
+        {
+            if (depth && stack[depth - 1] == '{')
+            {
+                if (at >= end || *at != '"') return -1;
+                at = gon_json_string_end(at + 1, end);
+                if (at >= end) return -1;
+                at = gon_json_skip_whitespace(at + 1, end);
+                if (at >= end || *at != ':') return -1;
+                at = gon_json_skip_whitespace(at + 1, end);
+            }
+
+            if (at >= end) return -1;
+            count += 1;
+
+            char c = *at;
+            if (c == '{' || c == '[')
+            {
+                if (depth == GON_JSON_MAX_DEPTH) return -1;
+                stack[depth++] = c;
+                at = gon_json_skip_whitespace(at + 1, end);
+                if (at < end && *at == (c == '{' ? '}' : ']'))
+                {
+                    depth -= 1;
+                    at++;
+                    expect_value = 0;
+                }
+                continue;
+            }
+            else if (c == '"')
+            {
+                at = gon_json_string_end(at + 1, end);
+                if (at >= end) return -1;
+                at++;
+            }
+            else
+            {
+                char *scalar_end = gon_json_scalar_end(at, end);
+                if (!gon_json_valid_scalar(span(at, scalar_end))) return -1;
+                at = scalar_end;
+            }
+            expect_value = 0;
+        }
+        else
+        {
+            if (!depth)
+            {
+                return at == end ? count : -1;
+            }
+
+            if (at >= end) return -1;
+
+            if (*at == ',')
+            {
+                expect_value = 1;
+            }
+            else if (*at == (stack[depth - 1] == '{' ? '}' : ']'))
+            {
+                depth -= 1;
+            }
+            else
+            {
+                return -1;
+            }
+            at++;
+        }
+    }
+}
+
+// Fills `object` from the value at `at` and returns one past the value.
+// Containers keep their opening bracket in `value` until their children are laid out.
+static char *gon_json_value(GON_Object *object, char *at, char *end, _Bool is_member)
+{
+    char c = *at;
+    if (c == '{' || c == '[')
+    {
+        object->type = c == '{' ? GON_Block : GON_List;
+        object->value.data = at;
+        if (!is_member)
+        {
+            object->name.data = at;
+            object->name.len  = 1;
+            object->subtype  |= GON_Subtype_Anonymous;
+        }
+        return gon_json_container_end(at, end);
+    }
+
+    GON_Str scalar = {0};
+    _Bool is_string = c == '"';
+    if (is_string)
+    {
+        scalar = span(at + 1, gon_json_string_end(at + 1, end));
+        at = scalar.data + scalar.len + 1;
+    }
+    else
+    {
+        scalar = span(at, gon_json_scalar_end(at, end));
+        at = scalar.data + scalar.len;
+    }
+
+    if (is_member)
+    {
+        object->type = GON_Widget;
+        object->value.data = scalar.data;
+        object->value.len  = scalar.len;
+        if (is_string)
+        {
+            object->subtype |= GON_Subtype_Value_String;
+        }
+    }
+    else
+    {
+        object->type = GON_Ident;
+        object->name.data = scalar.data;
+        object->name.len  = scalar.len;
+        if (is_string)
+        {
+            object->subtype |= GON_Subtype_String;
+        }
+    }
+
+    return at;
+}
+
+// Appends the direct children of the container opening at `open` to `current`.
+static GON_Object *gon_json_children(char *open, char *end, GON_Object *parent, GON_Object *current)
+{
+    _Bool is_object = *open == '{';
+    char *at = open + 1;
+
+    for (;;)
+    {
+        at = gon_json_skip_whitespace(at, end);
+        if (at >= end || *at == '}' || *at == ']')
+        {
+            break;
+        }
+        if (*at == ',')
+        {
+            at++;
+            continue;
+        }
+
+        GON_Object *object = current++;
+        object->parent = parent;
+
+        if (is_object)
+        {
+            GON_Str key = span(at + 1, gon_json_string_end(at + 1, end));
+            object->name.data = key.data;
+            object->name.len  = key.len;
+            object->subtype  |= GON_Subtype_String;
+            at = gon_json_skip_whitespace(key.data + key.len + 1, end);
+            at = gon_json_skip_whitespace(at + 1, end); // overstep colon
+        }
+        else
+        {
+            object->subtype |= GON_Subtype_List_Item;
+        }
+
+        at = gon_json_value(object, at, end, is_object);
+
+        if (parent)
+        {
+            if (parent->children_len == 0)
+            {
+                parent->children = object;
+            }
+            parent->children_len += 1;
+        }
+    }
+
+    return current;
+}
+
+GON_API GON_Results gon_load_json(char *source)
+{
+    return gon_load_json2(source, strlen(source));
+}
+
+GON_API GON_Results gon_load_json2(char *source, ptrdiff_t source_len)
+{
+    GON_Allocator allocator = gon_get_stdlib_allocator();
+    return gon_load_json3(source, source_len, &allocator);
+}
+
+GON_API GON_Results gon_load_json3(char *source, ptrdiff_t source_len, GON_Allocator *allocator)
+{
+    GON_Results results = {0};
+
+    int count = gon_json_count(source, source_len);
+    if (count < 0)
+    {
+        return results;
+    }
+
+    char *end = source + source_len;
+    char *document = gon_json_skip_whitespace(source, end);
+
+    // A top level object is the implicit GON file scope, so it has no object of its own
+    _Bool document_is_object = *document == '{';
+    if (document_is_object)
+    {
+        count -= 1;
+    }
+
+    ptrdiff_t cap = sizeof(GON_Object) * (1 + count);
+    char *mem = allocator->malloc(cap, allocator->ctx);
+    if (!mem)
+    {
+        return results;
+    }
+
+    GON_Linear_Allocator perm = {0};
+    perm.beg = mem;
+    perm.end = mem + cap;
+
+    GON_Object *final = new(&perm, GON_Object, count);
+    GON_Object *current = final;
+
+    // Same breadth-first layout as gon_objects: lay out the top level scope,
+    // then walk `final` appending each container's direct children to the end.
+    if (document_is_object)
+    {
+        current = gon_json_children(document, end, 0, current);
+    }
+    else
+    {
+        gon_json_value(current, document, end, 0);
+        current->subtype |= GON_Subtype_Anonymous;
+        current++;
+    }
+    results.top_level_results_len = (int) (current - final);
+
+    for (int i = 0; i < count; i++)
+    {
+        GON_Object *parent = &final[i];
+        if (parent->type == GON_Block || parent->type == GON_List)
+        {
+            char *open = parent->value.data;
+            parent->value.data = 0;
+            current = gon_json_children(open, end, parent, current);
+        }
+    }
+
+    results.results = final;
+    results.all_results_len = count;
+    results.free_this = mem;
+    results.free_this_size = cap;
+    results.ok = 1;
+    return results;
+}
+
+static void gon_json_put(GON_Json_Writer *writer, char *data, ptrdiff_t len)
+{
+    if (writer->buf)
+    {
+        memcpy(writer->buf + writer->len, data, len);
+    }
+    writer->len += len;
+}
+
+static void gon_json_putc(GON_Json_Writer *writer, char c)
+{
+    if (writer->buf)
+    {
+        writer->buf[writer->len] = c;
+    }
+    writer->len += 1;
+}
+
+// `keep_escapes` passes backslash sequences through untouched, for GON strings
+// whose escapes are already spelled out in the source.
+static void gon_json_put_string(GON_Json_Writer *writer, GON_Str s, _Bool keep_escapes)
+{
+    static char hex[] = "0123456789abcdef";
+
+    gon_json_putc(writer, '"');
+
+    char *at  = s.data;
+    char *end = s.data + s.len;
+    while (at < end)
+    {
+        // Copy the longest run that needs no escaping in one go
+        char *run = at;
+#ifdef GON_SIMD_SSE2
+        __m128i quote = _mm_set1_epi8('"');
+        __m128i slash = _mm_set1_epi8('\\');
+        __m128i control = _mm_set1_epi8(0x1f);
+        while (end - at >= 16)
+        {
+            __m128i chunk = _mm_loadu_si128((__m128i *) at);
+            __m128i is_control = _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control);
+            int mask = _mm_movemask_epi8(_mm_or_si128(is_control,
+                                                      _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                                                   _mm_cmpeq_epi8(chunk, slash))));
+            if (mask)
+            {
+                at += gon_ctz(mask);
+                break;
+            }
+            at += 16;
+        }
+#endif
+        while (at < end && *at != '"' && *at != '\\' && (unsigned char) *at >= 0x20)
+        {
+            at++;
+        }
+        gon_json_put(writer, run, at - run);
+
+        if (at >= end)
+        {
+            break;
+        }
+
+        char c = *at++;
+        if (c == '\\' && keep_escapes && at < end)
+        {
+            switch (*at)
+            {
+            case '"': case '\\': case '/': case 'b': case 'f':
+            case 'n': case 'r':  case 't': case 'u':
+                gon_json_putc(writer, '\\');
+                gon_json_putc(writer, *at++);
+                continue;
+            }
+        }
+
+        gon_json_putc(writer, '\\');
+        switch (c)
+        {
+        case '"':  gon_json_putc(writer, '"');  break;
+        case '\\': gon_json_putc(writer, '\\'); break;
+        case '\n': gon_json_putc(writer, 'n');  break;
+        case '\r': gon_json_putc(writer, 'r');  break;
+        case '\t': gon_json_putc(writer, 't');  break;
+        default:
+            gon_json_put(writer, "u00", 3);
+            gon_json_putc(writer, hex[(c >> 4) & 15]);
+            gon_json_putc(writer, hex[c & 15]);
+            break;
+        }
+    }
+
+    gon_json_putc(writer, '"');
+}
+
+static void gon_json_put_scalar(GON_Json_Writer *writer, GON_Str s, _Bool is_string)
+{
+    if (!is_string && gon_json_valid_scalar(s))
+    {
+        gon_json_put(writer, s.data, s.len);
+    }
+    else
+    {
+        gon_json_put_string(writer, s, is_string);
+    }
+}
+
+static void gon_json_put_object(GON_Json_Writer *writer, GON_Object *object, _Bool is_member)
+{
+    GON_Str name  = U(object->name.data, object->name.len);
+    GON_Str value = U(object->value.data, object->value.len);
+
+    if (is_member)
+    {
+        gon_json_put_string(writer, name, (object->subtype & GON_Subtype_String) != 0);
+        gon_json_putc(writer, ':');
+    }
+
+    switch (object->type)
+    {
+    case GON_Block:
+    case GON_List: {
+        _Bool is_block = object->type == GON_Block;
+        gon_json_putc(writer, is_block ? '{' : '[');
+        for (int i = 0; i < object->children_len; i++)
+        {
+            if (i)
+            {
+                gon_json_putc(writer, ',');
+            }
+            gon_json_put_object(writer, &object->children[i], is_block);
+        }
+        gon_json_putc(writer, is_block ? '}' : ']');
+        break;
+    }
+    case GON_Widget:
+        gon_json_put_scalar(writer, value, (object->subtype & GON_Subtype_Value_String) != 0);
+        break;
+    default:
+        if (is_member)
+        {
+            // A bare name inside a block has nothing to pair it with
+            gon_json_put(writer, "null", 4);
+        }
+        else
+        {
+            gon_json_put_scalar(writer, name, (object->subtype & GON_Subtype_String) != 0);
+        }
+        break;
+    }
+}
+
+static void gon_json_put_results(GON_Json_Writer *writer, GON_Results results)
+{
+    // Documents that were a bare array or value in JSON round trip as one anonymous object
+    if (results.top_level_results_len == 1 && (results.results[0].subtype & GON_Subtype_Anonymous))
+    {
+        gon_json_put_object(writer, &results.results[0], 0);
+        return;
+    }
+
+    gon_json_putc(writer, '{');
+    for (int i = 0; i < results.top_level_results_len; i++)
+    {
+        if (i)
+        {
+            gon_json_putc(writer, ',');
+        }
+        gon_json_put_object(writer, &results.results[i], 1);
+    }
+    gon_json_putc(writer, '}');
+}
+
+GON_API GON_Json gon_to_json(GON_Results results)
+{
+    GON_Allocator allocator = gon_get_stdlib_allocator();
+    return gon_to_json1(results, &allocator);
+}
+
+GON_API GON_Json gon_to_json1(GON_Results results, GON_Allocator *allocator)
+{
+    GON_Json json = {0};
+    if (!results.ok)
+    {
+        return json;
+    }
+
+    // Measure first so the output is a single exact allocation
+    GON_Json_Writer writer = {0};
+    gon_json_put_results(&writer, results);
+
+    writer.buf = allocator->malloc(writer.len + 1, allocator->ctx);
+    if (writer.buf)
+    {
+        writer.len = 0;
+        gon_json_put_results(&writer, results);
+        writer.buf[writer.len] = 0;
+
+        json.data = writer.buf;
+        json.len  = writer.len;
+        json.ok   = 1;
+    }
+
+    return json;
+}
+
+GON_API void gon_free_json(GON_Json json)
+{
+    GON_Allocator alloc = gon_get_stdlib_allocator();
+    gon_free_json1(json, alloc);
+}
+
+GON_API void gon_free_json1(GON_Json json, GON_Allocator alloc)
+{
+    alloc.free(json.data, alloc.ctx);
+}
+
 #undef new
 #undef R
 #undef U
@@ -30,6 +30,7 @@
 #define GON_H
 
 #define GON_MAX_SUB_OBJECT_DEPTH 5
+#define GON_ERROR_PATH_MAX 128
 
 #if defined(_WIN32)
     // Microsoft attibutes to tell compiler that symbols are imported/exported from a .dll
@@ -42,12 +43,13 @@
     #endif
 #else
     #if defined (__ELF__)
-        #define GON_API __attribute__((visibility "default"))
+        #define GON_API __attribute__((visibility("default")))
     #else
         #define GON_API
     #endif
 #endif
 
+#include <stddef.h>
 #include <stdint.h>
 
 typedef struct
@@ -69,9 +71,10 @@ typedef enum
 
 typedef enum
 {
-    GON_Subtype_Anonymous = 1 << 0,
-    GON_Subtype_List_Item = 1 << 1,
-    GON_Subtype_String    = 1 << 2,
+    GON_Subtype_Anonymous    = 1 << 0,
+    GON_Subtype_List_Item    = 1 << 1,
+    GON_Subtype_String       = 1 << 2,
+    GON_Subtype_Value_String = 1 << 3,
 } GON_Subtype;
 
 typedef struct GON_Object GON_Object;
@@ -96,10 +99,47 @@ struct GON_Object
     GON_Subtype subtype;
 };
 
+typedef enum
+{
+    GON_Error_None,
+    GON_Error_Unexpected_Token,
+    GON_Error_Unterminated_String,
+    GON_Error_Unbalanced,
+    GON_Error_Too_Deep,
+} GON_Error_Code;
+
+/* Filled in where parsing first failed. Kept small so the success path never pays for it, */
+/* use gon_error_location to turn it into a line, column and nesting path. */
+typedef struct
+{
+    GON_Error_Code code;
+    ptrdiff_t offset; /* bytes into source */
+    char *expected;   /* static description of what the parser wanted */
+
+    struct {
+        char *data;
+        ptrdiff_t len;
+    }found;           /* offending token, empty at end of input */
+} GON_Error;
+
+typedef struct
+{
+    int line;   /* 1 based */
+    int column; /* 1 based, in bytes */
+
+    struct {
+        char *data;
+        ptrdiff_t len;
+    }line_text;
+
+    char path[GON_ERROR_PATH_MAX]; /* enclosing blocks and lists, e.g. stats.tags[2] */
+} GON_Error_Location;
+
 typedef struct
 {
     GON_Object *results;
     _Bool ok;
+    GON_Error error;
 
     void *free_this;
     ptrdiff_t free_this_size;
@@ -108,6 +148,13 @@ typedef struct
     int all_results_len;
 } GON_Results;
 
+typedef struct
+{
+    char *data;
+    ptrdiff_t len;
+    _Bool ok;
+} GON_Json;
+
 /* Essential parsing functions */
 
 GON_API int gon_object_count(char *source);
@@ -122,6 +169,12 @@ GON_API GON_Results gon_load3(char *source, ptrdiff_t source_len, GON_Allocator
 GON_API void gon_free(GON_Results results);
 GON_API void gon_free1(GON_Results results, GON_Allocator alloc);
 
+/* Error reporting, only worth calling once `ok` is false */
+
+GON_API GON_Error_Location gon_error_location(char *source, ptrdiff_t source_len, GON_Error error);
+/* Writes "line:column: expected ..., found ... in path" to `buf`, returns the snprintf length. */
+GON_API int gon_error_format(char *source, ptrdiff_t source_len, GON_Error error, char *buf, int buf_len);
+
 /* Querying functions */
 
 GON_API GON_Object gon_top_level(GON_Results results, char *name);
@@ -132,6 +185,23 @@ GON_API GON_Object gon_get1(GON_Object object, char *name, ptrdiff_t name_len);
 GON_API int gon_children_total(GON_Object object);
 GON_API int gon_children_total2(GON_Object a, GON_Object b);
 
+/* JSON interop */
+
+/* Reads JSON straight into the same breadth-first layout gon_load produces. */
+/* Object members become named objects, array elements become list items. */
+/* Like gon_load, names and values point into `source` with quotes stripped */
+/* and escape sequences left untouched. */
+GON_API GON_Results gon_load_json(char *source);
+GON_API GON_Results gon_load_json2(char *source, ptrdiff_t source_len);
+GON_API GON_Results gon_load_json3(char *source, ptrdiff_t source_len, GON_Allocator *alloc);
+
+/* Writes `results` out as compact JSON. Free the output with gon_free_json. */
+GON_API GON_Json gon_to_json(GON_Results results);
+GON_API GON_Json gon_to_json1(GON_Results results, GON_Allocator *alloc);
+
+GON_API void gon_free_json(GON_Json json);
+GON_API void gon_free_json1(GON_Json json, GON_Allocator alloc);
+
 #endif // GON_H
 
 #ifdef GON_IMPLEMENTATION
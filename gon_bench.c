@@ -0,0 +1,385 @@
+/*
+ *  gon_bench.c - throughput benchmark and fuzzing harness for gon.c
+ *
+ *  Benchmark, prints one JSON object per line:
+ *      cc -O2 gon_bench.c -o gon_bench
+ *      ./gon_bench [max_bytes]
+ *
+ *  Fuzzer, checks the GON parser, the JSON reader and the JSON writer agree on the same input:
+ *      clang -O1 -g -fsanitize=fuzzer,address -DGON_FUZZ gon_bench.c -o gon_fuzz
+ *      ./gon_fuzz
+ */
+
+#define GON_IMPLEMENTATION
+#include "gon.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+
+#define assert(c) if (!(c)) __builtin_trap()
+
+typedef struct
+{
+    ptrdiff_t allocations;
+    ptrdiff_t bytes;
+} Counting_Allocator;
+
+static void *counting_malloc(ptrdiff_t size, void *ctx)
+{
+    Counting_Allocator *counter = ctx;
+    counter->allocations += 1;
+    counter->bytes += size;
+    return malloc(size);
+}
+
+static void counting_free(void *ptr, void *ctx)
+{
+    (void) ctx;
+    free(ptr);
+}
+
+static GON_Allocator counting_allocator(Counting_Allocator *counter)
+{
+    GON_Allocator allocator = {0};
+    allocator.malloc = &counting_malloc;
+    allocator.free   = &counting_free;
+    allocator.ctx    = counter;
+    return allocator;
+}
+
+#ifdef GON_FUZZ
+
+static GON_Type container_type(GON_Object object)
+{
+    return object.type == GON_Block || object.type == GON_List ? object.type : 0;
+}
+
+// JSON keeps the shape of a parse but not its source bytes or scalar types,
+// so only containers and children are compared.
+static _Bool same_shape(GON_Object *a, GON_Object *b, int len)
+{
+    for (int i = 0; i < len; i++)
+    {
+        if (container_type(a[i]) != container_type(b[i]) ||
+            a[i].children_len != b[i].children_len ||
+            !same_shape(a[i].children, b[i].children, a[i].children_len))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// A lone anonymous object is written as the JSON document itself, compare what is inside it
+static GON_Object *document(GON_Results results, int *len)
+{
+    if (results.top_level_results_len == 1 && (results.results[0].subtype & GON_Subtype_Anonymous))
+    {
+        *len = results.results[0].children_len;
+        return results.results[0].children;
+    }
+    *len = results.top_level_results_len;
+    return results.results;
+}
+
+static int max_depth(GON_Object *objects, int len)
+{
+    int deepest = 0;
+    for (int i = 0; i < len; i++)
+    {
+        int depth = 1 + max_depth(objects[i].children, objects[i].children_len);
+        deepest = depth > deepest ? depth : deepest;
+    }
+    return deepest;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    char *source = malloc(size + 1);
+    memcpy(source, data, size);
+    source[size] = 0;
+
+    Counting_Allocator counter = {0};
+    GON_Allocator allocator = counting_allocator(&counter);
+
+    GON_Results loaded = gon_load3(source, size, &allocator);
+
+    if (loaded.ok)
+    {
+        assert(gon_object_count2(source, size) == loaded.all_results_len);
+    }
+    else
+    {
+        char message[256];
+        gon_error_format(source, size, loaded.error, message, sizeof(message));
+    }
+
+    // JSON must round trip to a fixed point
+    if (loaded.ok && max_depth(loaded.results, loaded.top_level_results_len) < GON_JSON_MAX_DEPTH)
+    {
+        GON_Json json = gon_to_json(loaded);
+        assert(json.ok);
+
+        // The JSON reader is a separate parser, it must rebuild the same tree
+        GON_Results reloaded = gon_load_json3(json.data, json.len, &allocator);
+        assert(reloaded.ok);
+        int loaded_len, reloaded_len;
+        GON_Object *loaded_document   = document(loaded, &loaded_len);
+        GON_Object *reloaded_document = document(reloaded, &reloaded_len);
+        assert(loaded_len == reloaded_len);
+        assert(same_shape(loaded_document, reloaded_document, loaded_len));
+
+        GON_Json again = gon_to_json(reloaded);
+        assert(again.len == json.len && !memcmp(again.data, json.data, json.len));
+
+        gon_free_json(again);
+        gon_free1(reloaded, allocator);
+        gon_free_json(json);
+    }
+
+    gon_free1(loaded, allocator);
+    free(source);
+    return 0;
+}
+
+#else
+
+typedef struct
+{
+    char *data;
+    ptrdiff_t len;
+    ptrdiff_t cap;
+} Buffer;
+
+static void append(Buffer *b, char *format, ...)
+{
+    for (;;)
+    {
+        va_list args;
+        va_start(args, format);
+        int len = vsnprintf(b->data + b->len, b->cap - b->len, format, args);
+        va_end(args);
+
+        if (len < b->cap - b->len)
+        {
+            b->len += len;
+            return;
+        }
+
+        b->cap  = b->cap ? b->cap * 2 : 1 << 16;
+        b->data = realloc(b->data, b->cap);
+        assert(b->data);
+    }
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15;
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t) rng_state;
+}
+
+/* Corpora */
+
+static void corpus_flat(Buffer *b, ptrdiff_t size)
+{
+    for (int block = 0; b->len < size; block++)
+    {
+        append(b, "block_%d {\n", block);
+        for (int i = 0; i < 1000 && b->len < size; i++)
+        {
+            append(b, "    key_%d %u\n", i, rng() % 100000);
+        }
+        append(b, "}\n");
+    }
+}
+
+static void corpus_deep(Buffer *b, ptrdiff_t size)
+{
+    for (int tree = 0; b->len < size; tree++)
+    {
+        int depth = 32;
+        for (int i = 0; i < depth; i++)
+        {
+            append(b, "level_%d_%d { value %d\n", tree, i, i);
+        }
+
+        // Lists may only go GON_MAX_SUB_OBJECT_DEPTH - 1 deep
+        append(b, "leaf ");
+        for (int i = 0; i < GON_MAX_SUB_OBJECT_DEPTH - 1; i++) append(b, "[");
+        append(b, "1, 2, 3");
+        for (int i = 0; i < GON_MAX_SUB_OBJECT_DEPTH - 1; i++) append(b, "]");
+        append(b, "\n");
+
+        for (int i = 0; i < depth; i++)
+        {
+            append(b, "}");
+        }
+        append(b, "\n");
+    }
+}
+
+static void corpus_strings(Buffer *b, ptrdiff_t size)
+{
+    for (int i = 0; b->len < size; i++)
+    {
+        append(b, "text_%d \"", i);
+        int words = 20 + rng() % 200;
+        for (int w = 0; w < words; w++)
+        {
+            append(b, w % 17 == 16 ? "\\\"quoted\\\" " : "lorem ipsum ");
+        }
+        append(b, "\"\n");
+    }
+}
+
+static void corpus_comments(Buffer *b, ptrdiff_t size)
+{
+    for (int i = 0; b->len < size; i++)
+    {
+        append(b, "-- a line comment describing entry %d in some detail\n", i);
+        append(b, "entry_%d %d -- trailing comment\n", i, i);
+        if (i % 8 == 0)
+        {
+            append(b, "--[[ a multiline comment\n     that spans\n     several lines ]]\n");
+        }
+    }
+}
+
+static void corpus_lists(Buffer *b, ptrdiff_t size)
+{
+    for (int i = 0; b->len < size; i++)
+    {
+        append(b, "numbers_%d [", i);
+        for (int n = 0; n < 64; n++)
+        {
+            append(b, n ? ", %u" : "%u", rng() % 1000);
+        }
+        append(b, "]\nitems_%d [{ id %d }, { id %d }, [a, b, c]]\n", i, i, i + 1);
+    }
+}
+
+/* Measurements */
+
+static volatile int query_sink; // keeps lookups from being optimized out
+
+static void report(char *corpus, ptrdiff_t bytes, char *op, double seconds, ptrdiff_t objects,
+                   ptrdiff_t allocations, ptrdiff_t alloc_bytes)
+{
+    seconds = seconds > 1e-9 ? seconds : 1e-9; // below timer resolution
+    printf("{\"corpus\":\"%s\",\"bytes\":%td,\"op\":\"%s\",\"seconds\":%.9f,"
+           "\"mb_per_s\":%.2f,\"objects_per_s\":%.0f,\"allocations\":%td,\"alloc_bytes\":%td}\n",
+           corpus, bytes, op, seconds,
+           (double) bytes / (1024.0 * 1024.0) / seconds,
+           (double) objects / seconds,
+           allocations, alloc_bytes);
+    fflush(stdout);
+}
+
+// Repeats until roughly a quarter second has passed and keeps the best run
+#define MEASURE(best, body)                                          \
+    do {                                                             \
+        double _total = 0;                                           \
+        best = 1e30;                                                 \
+        for (int _run = 0; _run < 100 && (_run < 3 || _total < 0.25); _run++) { \
+            double _start = now_seconds();                           \
+            body;                                                    \
+            double _elapsed = now_seconds() - _start;                \
+            _total += _elapsed;                                      \
+            best = _elapsed < best ? _elapsed : best;                \
+        }                                                            \
+    } while (0)
+
+static void bench_corpus(char *name, Buffer corpus)
+{
+    double best;
+    int count = 0;
+
+    MEASURE(best, count = gon_object_count2(corpus.data, corpus.len));
+    report(name, corpus.len, "gon_object_count2", best, count, 0, 0);
+
+    GON_Results results = {0};
+    MEASURE(best, gon_free(results); results = gon_load2(corpus.data, corpus.len));
+    assert(results.ok);
+    report(name, corpus.len, "gon_load2", best, results.all_results_len, 1, results.free_this_size);
+
+    // gon_load2 always goes through the stdlib, so count through gon_load3's identical path
+    Counting_Allocator counter = {0};
+    GON_Allocator allocator = counting_allocator(&counter);
+    MEASURE(best, counter.allocations = counter.bytes = 0;
+                  gon_free1(results, allocator);
+                  results = gon_load3(corpus.data, corpus.len, &allocator));
+    report(name, corpus.len, "gon_load3", best, results.all_results_len, counter.allocations, counter.bytes);
+
+    // Look up the first thousand top level objects by name, then every child of the first one
+    ptrdiff_t queries = 0;
+    MEASURE(best,
+        queries = 0;
+        for (int i = 0; i < results.top_level_results_len && i < 1000; i++)
+        {
+            GON_Object top = results.results[i];
+            query_sink += gon_top_level1(results, top.name.data, top.name.len).children_len;
+            queries += 1;
+            if (i == 0)
+            {
+                for (int c = 0; c < top.children_len; c++)
+                {
+                    query_sink += gon_get1(top, top.children[c].name.data, top.children[c].name.len).type;
+                    queries += 1;
+                }
+            }
+        });
+    report(name, corpus.len, "queries", best, queries, 0, 0);
+
+    GON_Json json = gon_to_json(results);
+    gon_free1(results, allocator);
+
+    GON_Results from_json = {0};
+    MEASURE(best, gon_free(from_json); from_json = gon_load_json2(json.data, json.len));
+    assert(from_json.ok);
+    report(name, json.len, "gon_load_json2", best, from_json.all_results_len, 1, from_json.free_this_size);
+    gon_free(from_json);
+    gon_free_json(json);
+}
+
+int main(int argc, char **argv)
+{
+    ptrdiff_t max_bytes = argc > 1 ? strtoll(argv[1], 0, 10) : 100 << 20;
+    ptrdiff_t sizes[] = { 1 << 10, 64 << 10, 1 << 20, 16 << 20, 100 << 20 };
+
+    struct {
+        char *name;
+        void (*generate)(Buffer *, ptrdiff_t);
+    } corpora[] = {
+        { "flat",     corpus_flat },
+        { "deep",     corpus_deep },
+        { "strings",  corpus_strings },
+        { "comments", corpus_comments },
+        { "lists",    corpus_lists },
+    };
+
+    for (int c = 0; c < (int) (sizeof(corpora) / sizeof(corpora[0])); c++)
+    {
+        for (int s = 0; s < (int) (sizeof(sizes) / sizeof(sizes[0])) && sizes[s] <= max_bytes; s++)
+        {
+            Buffer corpus = {0};
+            rng_state = 0x9e3779b97f4a7c15;
+            corpora[c].generate(&corpus, sizes[s]);
+            bench_corpus(corpora[c].name, corpus);
+            free(corpus.data);
+        }
+    }
+    return 0;
+}
+
+#endif
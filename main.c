@@ -15,9 +15,13 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
 
 #include "raylib.h"
 #include "raymath.h"
+
+#define TS_IMPLEMENTATION
+#include "text_scene.h"
 #include "ui.c"
 
 typedef enum {
@@ -138,6 +142,81 @@ void game_draw(Game game, Color tint)
     }
 }
 
+typedef struct
+{
+    TS_Entity_Store entities;
+    Vector2 *world;  // per entity, with every parent's position added in
+    ptrdiff_t asset; // the scene, its dependencies index `textures`
+} Level;
+
+// Node indices follow file order, so a parent's world position is known before its children's.
+// Parents only move their children, their rotation and scale are left out.
+_Bool level_init(Level *level, TS_Async_Loader *loader, ptrdiff_t asset)
+{
+    level->asset    = asset;
+    level->entities = ts_entity_template(&ts_async_asset(loader, asset)->scene, 0);
+    level->world    = calloc(level->entities.entities_len ? level->entities.entities_len : 1, sizeof(Vector2));
+    if (!level->entities.ok || !level->world)
+    {
+        return 0;
+    }
+
+    int32_t *parents = malloc((level->entities.entities_len ? level->entities.entities_len : 1) * sizeof(int32_t));
+    if (!parents)
+    {
+        return 0;
+    }
+    for (ptrdiff_t g = 0; g < level->entities.groups_len; g++)
+    {
+        TS_Entity_Group *group = &level->entities.groups[g];
+        for (ptrdiff_t i = 0; i < group->len; i++)
+        {
+            level->world[group->entity[i]] = (Vector2) {group->position_x[i], group->position_y[i]};
+            parents[group->entity[i]] = group->parent[i];
+        }
+    }
+    for (ptrdiff_t e = 0; e < level->entities.entities_len; e++)
+    {
+        if (parents[e] >= 0)
+        {
+            level->world[e] = Vector2Add(level->world[e], level->world[parents[e]]);
+        }
+    }
+    free(parents);
+    return 1;
+}
+
+void level_draw(Level *level, TS_Async_Loader *loader, Texture2D *textures)
+{
+    TS_Asset *scene = ts_async_asset(loader, level->asset);
+    for (ptrdiff_t g = 0; g < level->entities.groups_len; g++)
+    {
+        TS_Entity_Group *group = &level->entities.groups[g];
+        for (ptrdiff_t i = 0; i < group->len; i++)
+        {
+            int32_t texture = group->texture[i];
+            if (texture < 0 || texture >= scene->dependencies_len || scene->dependencies[texture] < 0 || !group->visible[i])
+            {
+                continue;
+            }
+
+            // Sprite2D draws centered on its position
+            Texture2D tex = textures[scene->dependencies[texture]];
+            Vector2 pos   = level->world[group->entity[i]];
+            Rectangle src_rect = {0, 0, (float) tex.width, (float) tex.height};
+            Rectangle dst_rect = {pos.x, pos.y, tex.width * group->scale_x[i], tex.height * group->scale_y[i]};
+            DrawTexturePro(tex, src_rect, dst_rect, (Vector2) {dst_rect.width * 0.5f, dst_rect.height * 0.5f}, group->rotation[i] * RAD2DEG, WHITE);
+        }
+    }
+}
+
+void level_free(Level *level)
+{
+    ts_entity_store_free(&level->entities, 0);
+    free(level->world);
+    *level = (Level) {0};
+}
+
 #define TICK_HZ 15
 #define MAX_FRAME_SKIP 8
 #define TIME_HISTORY_COUNT 4
@@ -157,11 +236,20 @@ int main(void)
     Game game = {0};
     Game temp_game = {0};
 
-    void *ui_arena_start = malloc(1 << 20);
-    ui_state.arena.beg = ui_arena_start; 
-    ui_state.arena.end = ui_state.arena.beg + (1 << 20);
+    char *ui_memory = malloc(1 << 20);
+    UI_InitArenas((Arena) {ui_memory, ui_memory + (512 << 10)},
+                  (Arena) {ui_memory + (512 << 10), ui_memory + (1 << 20)});
 
     ui_state.font = LoadFont("MonteCarloFixed12-Bold.ttf");
+    UI_InitGlobals();
+
+    // The level loads on worker threads while the window is already running.
+    // None ships with the repository, drop a level.tscn beside the executable.
+    static Texture2D level_textures[TS_ASYNC_MAX_ASSETS];
+    TS_Async_Loader *loader = FileExists("level.tscn") ? ts_async_begin(".", 4) : 0;
+    ptrdiff_t level_asset = loader ? ts_async_request(loader, "res://level.tscn") : -1;
+    Level level = {0};
+    _Bool level_ready = 0;
 
     int user_fps = 60;
     SetTargetFPS(user_fps);
@@ -199,6 +287,36 @@ int main(void)
             }
         }
 
+        // Textures have to reach the GPU from this thread, so uploads happen as loads finish
+        for (ptrdiff_t finished; loader && (finished = ts_async_poll(loader)) >= 0;)
+        {
+            TS_Asset *asset = ts_async_asset(loader, finished);
+            if (!asset->ok)
+            {
+                TraceLog(LOG_WARNING, "Could not load %s", asset->path);
+            }
+            else if (asset->kind == TS_Asset_File && IsFileExtension(asset->path, ".png"))
+            {
+                Image image = LoadImageFromMemory(".png", (unsigned char *) asset->data, (int) asset->data_len);
+                level_textures[finished] = LoadTextureFromImage(image);
+                UnloadImage(image);
+
+                // The GPU has its copy
+                free(asset->data);
+                asset->data     = 0;
+                asset->data_len = 0;
+            }
+        }
+        if (!level_ready && level_asset >= 0 && ts_async_ready(loader, level_asset))
+        {
+            level_ready = level_init(&level, loader, level_asset);
+            TraceLog(level_ready ? LOG_INFO : LOG_WARNING, level_ready ? "Level loaded" : "Could not build the level");
+            if (!level_ready)
+            {
+                level_asset = -1;
+            }
+        }
+
         // Gather frame input
         Input frame_input = {0};
         frame_input.cursor = GetMousePosition();
@@ -231,6 +349,10 @@ int main(void)
 
         BeginTextureMode(target);
         ClearBackground((Color){40, 45, 50, 255});
+        if (level_ready)
+        {
+            level_draw(&level, loader, level_textures);
+        }
         game_draw(game, WHITE);
         game_draw(temp_game, RED);
         EndTextureMode();
@@ -244,10 +366,12 @@ int main(void)
         Rectangle dest_rec = { -virtual_ratio, -virtual_ratio, window_width + (virtual_ratio*2), window_height + (virtual_ratio*2) }; 
         DrawTexturePro(target.texture, source_rec, dest_rec, (Vector2) {0}, 0.0f, WHITE);
 
+        UI_BeginBuild(GetScreenWidth(), GetScreenHeight(), frame_time);
         if (UI_Button(S("Click me!")))
         {
             TraceLog(LOG_INFO, "You clicked me!");
         }
+        UI_EndBuild();
         UI_Render();
 
         // DrawText(TextFormat("CURRENT FPS: %i", (int)((double) clocks_per_second / (double) delta_time)), GetScreenWidth() - 420, 40, 20, GREEN);
@@ -269,4 +393,14 @@ int main(void)
         DrawRectangle(bar_x, bar_y, (int)(bar_width * interp_ratio), bar_height, ORANGE);
         EndDrawing();
     }
+
+    for (int i = 0; i < TS_ASYNC_MAX_ASSETS; i++)
+    {
+        if (level_textures[i].id)
+        {
+            UnloadTexture(level_textures[i]);
+        }
+    }
+    level_free(&level);
+    ts_async_end(loader);
 }
@@ -1,12 +1,17 @@
+#ifndef TEXT_SCENE_C
+#define TEXT_SCENE_C
+
 #include "text_scene.h"
 
+#include <math.h>
 #include <string.h>
 
 #ifndef TEXT_SCENE_IGNORE_STDLIB
+#include <stdio.h>
 #include <stdlib.h>
 #endif
 
-#define assert(c) if (!(c)) __builtin_trap()
+#define ts_assert(c) if (!(c)) __builtin_trap()
 
 typedef struct
 {
@@ -21,14 +26,17 @@ typedef struct
 {
     TS_Str current;
     _Bool in_bracket;
+    _Bool read_only;
     _Bool error;
 } TS_State;
 
+// Growable array, items are referred to by index until it stops growing
 typedef struct
 {
-    char *beg;
-    char *end;
-} TS_Linear_Allocator;
+    char *data;
+    ptrdiff_t len; // in bytes
+    ptrdiff_t cap;
+} TS_Buffer;
 
 typedef struct {
     TS_Str   head;
@@ -36,24 +44,24 @@ typedef struct {
     _Bool ok;
 } TS_Cut;
 
-_Bool equals(TS_Str a, TS_Str b)
+static _Bool ts_equals(TS_Str a, TS_Str b)
 {
     return a.len==b.len && (!a.len || !memcmp(a.data, b.data, a.len));
 }
 
-TS_Str trimleft(TS_Str s)
+static TS_Str trimleft(TS_Str s)
 {
     for (; s.len && *s.data<=' '; s.data++, s.len--) {}
     return s;
 }
 
-TS_Str trimright(TS_Str s)
+static TS_Str trimright(TS_Str s)
 {
     for (; s.len && s.data[s.len-1]<=' '; s.len--) {}
     return s;
 }
 
-TS_Str substring(TS_Str s, ptrdiff_t i)
+static TS_Str substring(TS_Str s, ptrdiff_t i)
 {
     if (i) {
         s.data += i;
@@ -62,7 +70,7 @@ TS_Str substring(TS_Str s, ptrdiff_t i)
     return s;
 }
 
-TS_Str span(char *beg, char *end)
+static TS_Str span(char *beg, char *end)
 {
     TS_Str r = {0};
     r.data = beg;
@@ -70,53 +78,79 @@ TS_Str span(char *beg, char *end)
     return r;
 }
 
-TS_Cut cut(TS_Str s, char c)
+static TS_Cut cut(TS_Str s, char c)
 {
     TS_Cut r = {0};
     if (!s.len) return r;  // null pointer special case
     char *beg = s.data;
     char *end = s.data + s.len;
-    char *cut = beg;
-    for (; cut<end && *cut!=c; cut++) {}
+    char *cut = memchr(beg, c, end - beg);
+    cut = cut ? cut : end;
     r.ok   = cut < end;
     r.head = span(beg, cut);
     r.tail = span(cut+r.ok, end);
     return r;
 }
 
-TS_Cut cut_either(TS_Str s, char c0, char c1) // cut at either c0 or c1
+#define push(b, a, t)  (t *)ts_push(b, a, sizeof(t), _Alignof(t))
+static void *ts_push(TS_Buffer *b, TS_Allocator *allocator, ptrdiff_t size, ptrdiff_t align)
 {
-    TS_Cut r = {0};
-    if (!s.len) return r;  // null pointer special case
+    ptrdiff_t pad = -b->len & (align - 1);
+    if (b->cap - b->len - pad < size)
+    {
+        ptrdiff_t cap = b->cap ? b->cap : 4096;
+        while (cap - b->len - pad < size)
+        {
+            cap *= 2;
+        }
 
-    char *beg = s.data;
-    char *end = s.data + s.len;
-    char *cut = beg;
+        if (b->data && allocator->resize && allocator->resize(b->data, b->cap, cap, allocator->ctx))
+        {
+            b->cap = cap;
+            void *r = b->data + b->len + pad;
+            b->len += pad + size;
+            return memset(r, 0, size);
+        }
 
-    for (; cut < end; cut++) {
-        if (*cut == c0 || *cut == c1) break;
+        char *data = allocator->malloc(cap, allocator->ctx);
+        if (!data)
+        {
+            return 0;
+        }
+        if (b->len)
+        {
+            memcpy(data, b->data, b->len);
+        }
+        if (b->data)
+        {
+            allocator->free(b->data, allocator->ctx);
+        }
+        b->data = data;
+        b->cap  = cap;
     }
 
-    if (cut < end)
+    void *r = b->data + b->len + pad;
+    b->len += pad + size;
+    return memset(r, 0, size);
+}
+
+static _Bool ts_buffer_append(TS_Buffer *b, TS_Allocator *allocator, void *data, ptrdiff_t len)
+{
+    void *r = ts_push(b, allocator, len, 1);
+    if (r)
     {
-        r.ok   = 1;
-        r.head = span(beg, cut);
-        r.tail = span(cut + 1, end);
+        memcpy(r, data, len);
     }
-
-    return r;
+    return r != 0;
 }
 
-#define new(a, t, n)  (t *)ts_alloc(a, n, sizeof(t), _Alignof(t))
-static void *ts_alloc(TS_Linear_Allocator *a, ptrdiff_t count, ptrdiff_t size, ptrdiff_t align)
+static void ts_buffer_free(TS_Buffer *b, TS_Allocator *allocator)
 {
-    ptrdiff_t pad = (uintptr_t)a->end & (align - 1);
-    if (count > (a->end - a->beg - pad)/size) {
-        return 0;
+    if (b->data)
+    {
+        allocator->free(b->data, allocator->ctx);
     }
-    void *r = a->beg + pad;
-    a->beg += pad + count*size;
-    return memset(r, 0, count*size);
+    *b = (TS_Buffer) {0};
 }
 
 #ifndef TEXT_SCENE_IGNORE_STDLIB
@@ -157,66 +191,81 @@ typedef struct
     TS_Pair pair;
 } TS_Pair_Result;
 
-static TS_Chunk_Result ts_next_heading(TS_State *state)
+static TS_Chunk_Result ts_heading_from_line(TS_Str line)
 {
     TS_Chunk_Result result = {0};
 
-    TS_Cut c = {0};
-    c.tail = state->current;
-
-    c = cut(c.tail, '\n');
-    TS_Str line = c.head;
-    while (line.len && line.data[0] != '[')
-    {
-        c = cut(c.tail, '\n');
-        line = c.head;
-    }
-
     if (line.len && line.data[0] == '[')
     {
         line = substring(line, 1);
-        TS_Cut header_cut = cut(line, ' ');
+        TS_Str name = line;
+        for (name.len = 0; name.len < line.len && line.data[name.len] != ' ' && line.data[name.len] != ']'; name.len++) {}
 
-        _Bool found_header_match = 0;
-        if (equals(S("gd_scene"), header_cut.head))
+        if (ts_equals(S("gd_scene"), name) || ts_equals(S("gd_resource"), name))
         {
             result.chunk.heading = TS_Heading_File_Descriptor;
-            found_header_match = 1;
         }
-        else if (equals(S("ext_resource"), header_cut.head))
+        else if (ts_equals(S("ext_resource"), name))
         {
             result.chunk.heading = TS_Heading_Ext_Resource;
-            found_header_match = 1;
         }
-        else if (equals(S("sub_resource"), header_cut.head))
+        else if (ts_equals(S("sub_resource"), name))
         {
             result.chunk.heading = TS_Heading_Sub_Resource;
-            found_header_match = 1;
         }
-        else if (equals(S("node"), header_cut.head))
+        else if (ts_equals(S("node"), name))
         {
             result.chunk.heading = TS_Heading_Node;
-            found_header_match = 1;
         }
-        else if (equals(S("connection"), header_cut.head))
+        else if (ts_equals(S("connection"), name))
         {
-            result.chunk.heading = TS_Heading_Node;
-            found_header_match = 1;
+            result.chunk.heading = TS_Heading_Connection;
         }
-
-        if (found_header_match)
+        else if (ts_equals(S("resource"), name))
         {
-            result.chunk.source.data = header_cut.head.data;
-            result.chunk.source.len  = header_cut.head.len;
-            result.ok = 1;
+            result.chunk.heading = TS_Heading_Resource;
+        }
+        else
+        {
+            // Unknown sections such as [editable] are kept so nothing is lost on the way through
+            result.chunk.heading = TS_Heading_Nothing;
         }
-    }
 
-    state->current = c.tail;
+        result.chunk.source.data = name.data;
+        result.chunk.source.len  = name.len;
+        result.ok = 1;
+    }
 
     return result;
 }
 
+// Resolves escape sequences in place, returns the new length
+static ptrdiff_t ts_unescape(char *val, ptrdiff_t len)
+{
+    char *src = val;
+    char *dst = val;
+    int escaped = 0;
+
+    for (ptrdiff_t i = 0; i < len; i++) {
+        char ch = src[i];
+        if (escaped) {
+            switch (ch) {
+            case 'n':  *dst++ = '\n'; break;
+            case 't':  *dst++ = '\t'; break;
+            case '"':  *dst++ = '"';  break;
+            case '\\': *dst++ = '\\'; break;
+            default:   *dst++ = ch;   break;
+            }
+            escaped = 0;
+        } else if (ch == '\\') {
+            escaped = 1;
+        } else {
+            *dst++ = ch;
+        }
+    }
+    return dst - val;
+}
+
 static TS_Pair_Result ts_next_heading_pair(TS_State *state)
 {
     TS_Pair_Result result = {0};
@@ -272,11 +321,16 @@ static TS_Pair_Result ts_next_heading_pair(TS_State *state)
                 char *val_start = state->current.data;
                 ptrdiff_t val_len = 0;
                 while (val_len < state->current.len && val_start[val_len] != '"') {
-                    val_len++;
+                    val_len += val_start[val_len] == '\\' ? 2 : 1;
                 }
+                val_len = val_len < state->current.len ? val_len : state->current.len;
 
                 result.pair.value.data = val_start;
-                result.pair.value.len = val_len;
+                result.pair.value.len = state->read_only ? val_len : ts_unescape(val_start, val_len);
+                result.pair.flags = TS_Pair_Quoted;
+                if (state->read_only && memchr(val_start, '\\', val_len)) {
+                    result.pair.flags |= TS_Pair_Escaped;
+                }
 
                 if (val_len < state->current.len) {
                     state->current.data += val_len + 1;
@@ -319,25 +373,46 @@ static TS_Pair_Result ts_next_heading_pair(TS_State *state)
     return result;
 }
 
-static TS_Pair_Result ts_next_pair(TS_State *state)
+// Tracks brackets and strings so a value spanning several lines stays one logical line.
+// Returns the length up to and including the newline that ends it, or -1 if it runs past `len`.
+static ptrdiff_t ts_scan_line(TS_Line_Scan *scan, char *data, ptrdiff_t len)
 {
-    TS_Pair_Result result = {0};
-
-    TS_Cut c = {0};
-    c.tail = state->current;
-
-    TS_Str line = {0};
-    while (c.tail.len) {
-        c = cut(c.tail, '\n');
+    for (ptrdiff_t i = 0; i < len; i++)
+    {
+        char c = data[i];
+        if (scan->in_string)
+        {
+            scan->in_string = scan->escaped || c != '"';
+            scan->escaped   = !scan->escaped && c == '\\';
+            continue;
+        }
 
-        // found a non header pair?
-        if (c.head.data[0] != '[' && c.head.data[0] != ' ' && c.head.data[0] != '\r' && c.head.data[0] != '\t')
+        switch (c)
         {
-            line = c.head;
-            state->current = c.tail;
+        case '"':
+            scan->in_string = 1;
+            break;
+        case '[': case '(': case '{':
+            scan->depth += 1;
+            break;
+        case ']': case ')': case '}':
+            scan->depth -= 1;
+            break;
+        case '\n':
+            if (scan->depth <= 0)
+            {
+                scan->depth = 0;
+                return i + 1;
+            }
             break;
         }
     }
+    return -1;
+}
+
+static TS_Pair_Result ts_pair_from_line(TS_Str line, _Bool read_only)
+{
+    TS_Pair_Result result = {0};
 
     if (line.len)
     {
@@ -347,8 +422,7 @@ static TS_Pair_Result ts_next_pair(TS_State *state)
         result.pair.key.data = kv.head.data;
         result.pair.key.len  = kv.head.len;
 
-        kv = cut(kv.tail, '\n');
-        kv.head = trimleft(kv.head);
+        kv.head = trimleft(kv.tail);
         kv.head = trimright(kv.head);
 
         char *val = kv.head.data;
@@ -358,29 +432,12 @@ static TS_Pair_Result ts_next_pair(TS_State *state)
         if (len > 1 && val[0] == '"' && val[len - 1] == '"') {
             val++;
             len -= 2;
-
-            char *src = val;
-            char *dst = val;
-            int escaped = 0;
-
-            for (ptrdiff_t i = 0; i < len; i++) {
-                char ch = src[i];
-                if (escaped) {
-                    switch (ch) {
-                    case 'n':  *dst++ = '\n'; break;
-                    case 't':  *dst++ = '\t'; break;
-                    case '"':  *dst++ = '"';  break;
-                    case '\\': *dst++ = '\\'; break;
-                    default:   *dst++ = ch;   break;
-                    }
-                    escaped = 0;
-                } else if (ch == '\\') {
-                    escaped = 1;
-                } else {
-                    *dst++ = ch;
-                }
+            result.pair.flags = TS_Pair_Quoted;
+            if (!read_only) {
+                len = ts_unescape(val, len);
+            } else if (memchr(val, '\\', len)) {
+                result.pair.flags |= TS_Pair_Escaped;
             }
-            len = dst - val;
         }
 
         result.pair.value.data = val;
@@ -391,157 +448,4622 @@ static TS_Pair_Result ts_next_pair(TS_State *state)
     return result;
 }
 
-TS_Load_Result ts_load(char *source)
+/* Variants */
+
+// Blocks that never move once handed out, so decoded arrays can point into them
+// while the rest of the load is still growing its buffers.
+typedef struct TS_Block TS_Block;
+struct TS_Block
 {
-    TS_Allocator allocator = ts_get_stdlib_allocator();
-    return ts_load1(source, strlen(source), &allocator);
+    TS_Block *next;
+    char *beg;
+    char *end;
+};
+
+#define TS_BLOCK_SIZE (64 << 10)
+
+static void *ts_block_alloc(TS_Block **head, TS_Allocator *allocator, ptrdiff_t count, ptrdiff_t size, ptrdiff_t align)
+{
+    TS_Block *block = *head;
+    if (!block || count > (block->end - block->beg - (ptrdiff_t)(-(uintptr_t)block->beg & (align - 1)))/size)
+    {
+        ptrdiff_t cap = (ptrdiff_t) sizeof(TS_Block) + align + count*size;
+        cap = cap < TS_BLOCK_SIZE ? TS_BLOCK_SIZE : cap;
+        block = allocator->malloc(cap, allocator->ctx);
+        if (!block)
+        {
+            return 0;
+        }
+        block->next = *head;
+        block->beg  = (char *)(block + 1);
+        block->end  = (char *) block + cap;
+        *head = block;
+    }
+
+    ptrdiff_t pad = -(uintptr_t)block->beg & (align - 1);
+    void *r = block->beg + pad;
+    block->beg += pad + count*size;
+    return memset(r, 0, count*size);
 }
 
-TS_Load_Result ts_load1(char *source, ptrdiff_t source_len, TS_Allocator *allocator)
+static void ts_blocks_free(TS_Block *block, TS_Allocator *allocator)
 {
-    TS_Allocator heap;
-    if (!allocator)
+    while (block)
     {
-        heap = ts_get_stdlib_allocator();
-        allocator = &heap;
+        TS_Block *next = block->next;
+        allocator->free(block, allocator->ctx);
+        block = next;
     }
+}
 
-    TS_Load_Result result = {0};
-    ptrdiff_t heading_count = 0;
-    ptrdiff_t heading_pair_count = 0;
-    ptrdiff_t pair_count = 0;
+// Walks a value twice: once with no slots to count how many nested items it
+// holds, then again filling slots handed out in order from one allocation.
+typedef struct
+{
+    char *at;
+    char *end;
+    TS_Variant *slots; // null while counting
+    ptrdiff_t used;
+    _Bool error;
+} TS_Variant_Parser;
+
+static const double ts_pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static _Bool ts_is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static _Bool ts_is_ident(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || ts_is_digit(c) || c == '_';
+}
+
+static void ts_skip_whitespace(TS_Variant_Parser *p)
+{
+    while (p->at < p->end && (*p->at == ' ' || *p->at == '\t' || *p->at == '\n' || *p->at == '\r'))
+    {
+        p->at++;
+    }
+}
+
+// Godot writes floats with at most 17 significant digits and small exponents,
+// so nearly everything takes the exact fast path: when the mantissa fits in a
+// double's 53 bits, one multiply or divide by an exact power of ten rounds correctly.
+static _Bool ts_parse_number(TS_Variant_Parser *p, TS_Variant *out)
+{
+    char *beg = p->at;
+    char *at  = p->at;
+    char *end = p->end;
+
+    _Bool negative = 0;
+    if (at < end && (*at == '-' || *at == '+'))
+    {
+        negative = *at++ == '-';
+    }
+
+    TS_Str rest = span(at, end);
+    if (rest.len >= 3 && (!memcmp(at, "inf", 3) || !memcmp(at, "nan", 3)) &&
+        (rest.len == 3 || !ts_is_ident(at[3])))
+    {
+        out->type = TS_Variant_Float;
+        out->real = at[0] == 'i' ? (negative ? -HUGE_VAL : HUGE_VAL) : NAN;
+        p->at = at + 3;
+        return 1;
+    }
 
-    TS_Chunk_Result current = {0};
-    TS_Pair_Result  current_pair = {0};
-    TS_State state = {0};
-    state.current = U(source, source_len);
+    uint64_t mantissa = 0;
+    int digits   = 0; // significant digits kept in mantissa
+    int exponent = 0;
+    _Bool any_digits = 0;
+    _Bool is_float   = 0;
 
-    // count headers
-    while ((current = ts_next_heading(&state)).ok)
+    for (; at < end && ts_is_digit(*at); at++)
     {
-        heading_count += 1;
+        any_digits = 1;
+        if (digits < 19)
+        {
+            mantissa = mantissa*10 + (*at - '0');
+            digits += mantissa != 0;
+        }
+        else
+        {
+            exponent++;
+        }
     }
 
-    // count heading pairs
-    if (!state.error)
+    if (at < end && *at == '.')
     {
-        state.current = U(source, source_len);
-        while ((current_pair = ts_next_heading_pair(&state)).ok)
+        is_float = 1;
+        for (at++; at < end && ts_is_digit(*at); at++)
         {
-            heading_pair_count += 1;
+            any_digits = 1;
+            if (digits < 19)
+            {
+                mantissa = mantissa*10 + (*at - '0');
+                digits += mantissa != 0;
+                exponent--;
+            }
         }
     }
 
-    // count pairs
-    if (!state.error)
+    if (!any_digits)
     {
-        state.current = U(source, source_len);
-        while ((current_pair = ts_next_pair(&state)).ok)
+        return 0;
+    }
+
+    if (at < end && (*at == 'e' || *at == 'E'))
+    {
+        is_float = 1;
+        at++;
+        _Bool negative_exponent = 0;
+        if (at < end && (*at == '-' || *at == '+'))
+        {
+            negative_exponent = *at++ == '-';
+        }
+        if (at == end || !ts_is_digit(*at))
+        {
+            return 0;
+        }
+        int e = 0;
+        for (; at < end && ts_is_digit(*at); at++)
         {
-            pair_count += 1;
+            e = e < 10000 ? e*10 + (*at - '0') : e;
         }
+        exponent += negative_exponent ? -e : e;
     }
+    p->at = at;
 
-    if (!state.error)
+    if (!is_float)
     {
-        result.chunks    = allocator->malloc(heading_count * sizeof(TS_Chunk), allocator->ctx);
-        result.all_pairs = allocator->malloc((heading_pair_count + pair_count) * sizeof(TS_Pair), allocator->ctx);
+        if (digits == 19 && mantissa > (uint64_t) INT64_MAX + negative)
+        {
+            return 0;
+        }
+        if (exponent)
+        {
+            return 0; // more than 19 digits
+        }
+        out->type    = TS_Variant_Int;
+        out->integer = negative ? (int64_t)(0 - mantissa) : (int64_t) mantissa;
+        return 1;
     }
 
-    if (result.chunks && result.all_pairs)
+    out->type = TS_Variant_Float;
+    if (mantissa <= (uint64_t) 1 << 53 && exponent >= -22 && exponent <= 22)
     {
-        TS_Linear_Allocator chunk_arena = {0};
-        chunk_arena.beg = (char*) result.chunks;
-        chunk_arena.end = (char*) result.chunks + heading_count * sizeof(TS_Chunk);
+        double value = (double) mantissa;
+        value = exponent < 0 ? value / ts_pow10[-exponent] : value * ts_pow10[exponent];
+        out->real = negative ? -value : value;
+    }
+    else
+    {
+        // Slow path, strtod wants a terminated copy
+        char copy[64];
+        ptrdiff_t len = at - beg;
+        if (len >= (ptrdiff_t) sizeof(copy))
+        {
+            return 0;
+        }
+        memcpy(copy, beg, len);
+        copy[len] = 0;
+        out->real = strtod(copy, 0);
+    }
+    return 1;
+}
 
-        TS_Linear_Allocator pair_arena = {0};
-        pair_arena.beg = (char*) result.all_pairs;
-        pair_arena.end = (char*) result.all_pairs + ((heading_pair_count + pair_count) * sizeof(TS_Pair));
+static _Bool ts_parse_quoted(TS_Variant_Parser *p, TS_Str *out)
+{
+    if (p->at == p->end || *p->at != '"')
+    {
+        return 0;
+    }
 
-        state.current = U(source, source_len);
-        while ((current = ts_next_heading(&state)).ok)
+    char *beg = ++p->at;
+    for (; p->at < p->end && *p->at != '"'; p->at++)
+    {
+        if (*p->at == '\\' && p->at + 1 < p->end)
         {
-            TS_Chunk *chunk = new(&chunk_arena, TS_Chunk, 1);
-            *chunk = current.chunk;
+            p->at++;
+        }
+    }
+    if (p->at == p->end)
+    {
+        return 0;
+    }
+    *out = span(beg, p->at++);
+    return 1;
+}
+
+static _Bool ts_expect(TS_Variant_Parser *p, char c)
+{
+    ts_skip_whitespace(p);
+    if (p->at < p->end && *p->at == c)
+    {
+        p->at++;
+        return 1;
+    }
+    return 0;
+}
+
+static void ts_parse_variant(TS_Variant_Parser *p, TS_Variant *out);
+
+// Parses elements up to `close`, dictionaries as key: value. With slots the
+// elements land in `items`, otherwise they are only counted into p->used.
+static ptrdiff_t ts_parse_elements(TS_Variant_Parser *p, char close, _Bool dictionary, TS_Variant *items)
+{
+    ptrdiff_t len = 0;
+    TS_Variant scratch;
+
+    if (ts_expect(p, close))
+    {
+        return 0;
+    }
 
-            if (result.chunks_len == 0)
+    for (;;)
+    {
+        for (int k = 0; k < 1 + dictionary; k++)
+        {
+            if (k && !ts_expect(p, ':'))
+            {
+                p->error = 1;
+                return len;
+            }
+            ts_parse_variant(p, items ? &items[len] : &scratch);
+            if (p->error)
+            {
+                return len;
+            }
+            if (!items)
             {
-                result.chunks = chunk;
+                p->used += 1;
             }
+            len += 1;
+        }
 
-            result.chunks_len += 1;
+        if (ts_expect(p, close))
+        {
+            return len;
+        }
+        if (!ts_expect(p, ','))
+        {
+            p->error = 1;
+            return len;
+        }
+        if (ts_expect(p, close)) // trailing comma
+        {
+            return len;
         }
+    }
+}
+
+static void ts_parse_container(TS_Variant_Parser *p, TS_Variant *out)
+{
+    _Bool dictionary = *p->at == '{';
+    char close = dictionary ? '}' : ']';
+    p->at++;
 
-        for (int i = 0; i < result.chunks_len; i++)
+    TS_Variant *items = 0;
+    if (p->slots)
+    {
+        // Count this level first so its items come out contiguous
+        TS_Variant_Parser counter = *p;
+        counter.slots = 0;
+        ptrdiff_t len = ts_parse_elements(&counter, close, dictionary, 0);
+        if (counter.error)
         {
-           TS_Chunk *chunk = &result.chunks[i];
+            p->error = 1;
+            return;
+        }
+        items = len ? p->slots + p->used : 0;
+        p->used += len;
+    }
 
-           // Create sub-context to scan heading pairs inside `[]`
-           TS_State chunk_context = {0};
-           chunk_context.current.data = chunk->source.data - 1;
-           chunk_context.current.len = 1;
+    ptrdiff_t len = ts_parse_elements(p, close, dictionary, items);
+    out->type = dictionary ? TS_Variant_Dictionary : TS_Variant_Array;
+    out->array.items = items;
+    out->array.len   = dictionary ? len / 2 : len;
+}
+
+typedef struct
+{
+    TS_Str name;
+    TS_Variant_Type type;
+    int count;
+    _Bool integer;
+} TS_Vector_Constructor;
 
-           char *iter = chunk->source.data;
-           while (*iter && *iter != ']') iter++;
-           if (*iter == ']') iter++;
-           chunk_context.current.len = iter - chunk_context.current.data;
+static const TS_Vector_Constructor ts_vector_constructors[] = {
+    { {"Vector2",     7}, TS_Variant_Vector2,     2, 0 },
+    { {"Vector2i",    8}, TS_Variant_Vector2i,    2, 1 },
+    { {"Vector3",     7}, TS_Variant_Vector3,     3, 0 },
+    { {"Vector3i",    8}, TS_Variant_Vector3i,    3, 1 },
+    { {"Vector4",     7}, TS_Variant_Vector4,     4, 0 },
+    { {"Vector4i",    8}, TS_Variant_Vector4i,    4, 1 },
+    { {"Rect2",       5}, TS_Variant_Rect2,       4, 0 },
+    { {"Rect2i",      6}, TS_Variant_Rect2i,      4, 1 },
+    { {"Color",       5}, TS_Variant_Color,       4, 0 },
+    { {"Quaternion", 10}, TS_Variant_Quaternion,  4, 0 },
+    { {"Plane",       5}, TS_Variant_Plane,       4, 0 },
+    { {"Transform2D",11}, TS_Variant_Transform2D, 6, 0 },
+};
 
-           while ((current_pair = ts_next_heading_pair(&chunk_context)).ok)
-           {
-               TS_Pair *heading_pair = new(&pair_arena, TS_Pair, 1);
-               *heading_pair = current_pair.pair;
-               if (!chunk->heading_pairs)
-                   chunk->heading_pairs = heading_pair;
-               chunk->heading_pairs_len += 1;
-           }
+// Finds the parenthesis closing the one just before p->at, skipping strings
+static char *ts_closing_paren(TS_Variant_Parser *p)
+{
+    int depth = 1;
+    for (char *at = p->at; at < p->end; at++)
+    {
+        if (*at == '"')
+        {
+            for (at++; at < p->end && *at != '"'; at++)
+            {
+                at += *at == '\\';
+            }
+        }
+        else if (*at == '(')
+        {
+            depth++;
+        }
+        else if (*at == ')' && !--depth)
+        {
+            return at;
         }
+    }
+    return 0;
+}
+
+static void ts_parse_constructor(TS_Variant_Parser *p, TS_Str name, TS_Variant *out)
+{
+    char *args_beg = p->at;
 
-        for (int i = 0; i < result.chunks_len; i++)
+    for (int c = 0; c < (int)(sizeof(ts_vector_constructors) / sizeof(ts_vector_constructors[0])); c++)
+    {
+        const TS_Vector_Constructor *vector = &ts_vector_constructors[c];
+        if (!ts_equals(vector->name, name))
         {
-            TS_Chunk *chunk = &result.chunks[i];
-            _Bool last_chunk = i == result.chunks_len - 1;
+            continue;
+        }
 
-            // Funky source narrowing. Basically create a buffer from
-            // The chunk [ to the next chunk [ or eof.
-            TS_State chunk_context = {0};
-            chunk_context.current.data = chunk->source.data;
+        for (int i = 0; i < vector->count; i++)
+        {
+            TS_Variant number = {0};
+            ts_skip_whitespace(p);
+            if ((i && !ts_expect(p, ',')) || (ts_skip_whitespace(p), !ts_parse_number(p, &number)))
+            {
+                p->error = 1;
+                return;
+            }
 
-            if (!last_chunk)
+            if (vector->integer)
             {
-                TS_Chunk *next_chunk = &result.chunks[i + 1];
-                chunk_context.current.len = next_chunk->source.data - chunk->source.data;
+                // Only whole numbers that fit, a float here is an error rather than truncated
+                if (number.type != TS_Variant_Int || number.integer < INT32_MIN || number.integer > INT32_MAX)
+                {
+                    p->error = 1;
+                    return;
+                }
+                out->i[i] = (int32_t) number.integer;
             }
             else
             {
-                chunk_context.current.len = source_len - (chunk->source.data - source);
+                out->f[i] = number.type == TS_Variant_Int ? (float) number.integer : (float) number.real;
             }
+        }
 
-            chunk_context.current.data--;
-            chunk_context.current.len++;
-            // Narrowing End
-
-            while ((current_pair = ts_next_pair(&chunk_context)).ok)
-            {
-                TS_Pair *pair = new(&pair_arena, TS_Pair, 1);
-                *pair = current_pair.pair;
+        if (!ts_expect(p, ')'))
+        {
+            p->error = 1;
+            return;
+        }
+        out->type = vector->type;
+        return;
+    }
 
-                if (!chunk->pairs)
-                {
-                    chunk->pairs = pair;
-                }
+    _Bool ext  = ts_equals(S("ExtResource"), name);
+    _Bool sub  = ts_equals(S("SubResource"), name);
+    _Bool path = ts_equals(S("NodePath"), name);
+    if (ext || sub || path)
+    {
+        TS_Str id = {0};
+        ts_skip_whitespace(p);
+        if (!ts_parse_quoted(p, &id) && !(ext && ts_parse_number(p, out)))
+        {
+            p->error = 1;
+            return;
+        }
+        if (!id.data) // Godot 3 numeric ids
+        {
+            id = span(args_beg, p->at);
+            id = trimleft(id);
+        }
+        if (!ts_expect(p, ')'))
+        {
+            p->error = 1;
+            return;
+        }
+        out->type = ext ? TS_Variant_Ext_Resource : sub ? TS_Variant_Sub_Resource : TS_Variant_Node_Path;
+        out->resource.data  = id.data;
+        out->resource.len   = id.len;
+        out->resource.index = -1;
+        return;
+    }
 
-                chunk->pairs_len += 1;
+    if (ts_equals(S("Array"), name) || ts_equals(S("Dictionary"), name))
+    {
+        ts_skip_whitespace(p);
+        if (p->at < p->end && (*p->at == '[' || *p->at == '{'))
+        {
+            ts_parse_container(p, out);
+            if (!p->error && !ts_expect(p, ')'))
+            {
+                p->error = 1;
             }
+            return;
         }
+    }
 
-        result.ok = 1;
+    char *args_end = ts_closing_paren(p);
+    if (!args_end)
+    {
+        p->error = 1;
+        return;
     }
+    p->at = args_end + 1;
+    out->type = TS_Variant_Constructor;
+    out->constructor.name.data = name.data;
+    out->constructor.name.len  = name.len;
+    out->constructor.args.data = args_beg;
+    out->constructor.args.len  = args_end - args_beg;
+}
 
+static void ts_parse_variant(TS_Variant_Parser *p, TS_Variant *out)
+{
+    *out = (TS_Variant) {0};
+    ts_skip_whitespace(p);
+    if (p->at == p->end)
+    {
+        p->error = 1;
+        return;
+    }
 
-    return result;
-}
+    char c = *p->at;
+    if (c == '"' || ((c == '&' || c == '^') && p->at + 1 < p->end))
+    {
+        TS_Str string = {0};
+        p->at += c != '"';
+        if (!ts_parse_quoted(p, &string))
+        {
+            p->error = 1;
+            return;
+        }
+        out->type = c == '&' ? TS_Variant_String_Name : c == '^' ? TS_Variant_Node_Path : TS_Variant_String;
+        out->string.data = string.data;
+        out->string.len  = string.len;
+    }
+    else if (c == '[' || c == '{')
+    {
+        ts_parse_container(p, out);
+    }
+    else if (ts_is_digit(c) || c == '-' || c == '+' || c == '.')
+    {
+        p->error = !ts_parse_number(p, out);
+    }
+    else if (ts_is_ident(c))
+    {
+        char *beg = p->at;
+        while (p->at < p->end && ts_is_ident(*p->at))
+        {
+            p->at++;
+        }
+        TS_Str name = span(beg, p->at);
+
+        // Typed containers, Array[int]([1, 2]), keep only the contents
+        if (p->at < p->end && *p->at == '[')
+        {
+            int depth = 0;
+            for (; p->at < p->end; p->at++)
+            {
+                depth += (*p->at == '[') - (*p->at == ']');
+                if (!depth)
+                {
+                    p->at++;
+                    break;
+                }
+            }
+        }
+
+        if (ts_expect(p, '('))
+        {
+            ts_parse_constructor(p, name, out);
+        }
+        else if (ts_equals(S("true"), name) || ts_equals(S("false"), name))
+        {
+            out->type    = TS_Variant_Bool;
+            out->boolean = name.data[0] == 't';
+        }
+        else if (ts_equals(S("null"), name) || ts_equals(S("nil"), name))
+        {
+            out->type = TS_Variant_Nil;
+        }
+        else if (ts_equals(S("inf"), name) || ts_equals(S("nan"), name))
+        {
+            p->at = beg;
+            p->error = !ts_parse_number(p, out);
+        }
+        else
+        {
+            p->error = 1;
+        }
+    }
+    else
+    {
+        p->error = 1;
+    }
+}
+
+// With `blocks` the nested items come from the load's block list, otherwise
+// from one exact allocation owned by the root variant.
+static TS_Variant_Result ts_decode(TS_Str value, _Bool quoted, TS_Allocator *allocator, TS_Block **blocks, _Bool *out_of_memory)
+{
+    TS_Variant_Result result = {0};
+
+    if (quoted)
+    {
+        result.variant.type = TS_Variant_String;
+        result.variant.string.data = value.data;
+        result.variant.string.len  = value.len;
+        result.ok = 1;
+        return result;
+    }
+
+    TS_Variant_Parser counter = {0};
+    counter.at  = value.data;
+    counter.end = value.data + value.len;
+    ts_parse_variant(&counter, &result.variant);
+    ts_skip_whitespace(&counter);
+
+    result.ok = !counter.error && counter.at == counter.end;
+    if (result.ok && counter.used)
+    {
+        TS_Variant_Parser parser = {0};
+        parser.at  = value.data;
+        parser.end = value.data + value.len;
+        parser.slots = blocks
+            ? ts_block_alloc(blocks, allocator, counter.used, sizeof(TS_Variant), _Alignof(TS_Variant))
+            : allocator->malloc(counter.used * (ptrdiff_t) sizeof(TS_Variant), allocator->ctx);
+        result.ok = parser.slots != 0;
+        *out_of_memory = !result.ok;
+        if (result.ok)
+        {
+            ts_parse_variant(&parser, &result.variant);
+        }
+    }
+
+    if (!result.ok)
+    {
+        result.variant = (TS_Variant) {0};
+        result.variant.type = TS_Variant_Raw;
+        result.variant.string.data = value.data;
+        result.variant.string.len  = value.len;
+    }
+    return result;
+}
+
+TS_Variant_Result ts_decode_value(char *value, ptrdiff_t value_len, _Bool quoted, TS_Allocator *allocator)
+{
+    TS_Allocator heap;
+    if (!allocator)
+    {
+        heap = ts_get_stdlib_allocator();
+        allocator = &heap;
+    }
+    _Bool out_of_memory = 0;
+    return ts_decode(U(value, value_len), quoted, allocator, 0, &out_of_memory);
+}
+
+TS_Variant_Result ts_decode_pair(TS_Pair pair, TS_Allocator *allocator)
+{
+    return ts_decode_value(pair.value.data, pair.value.len, pair.flags & TS_Pair_Quoted, allocator);
+}
+
+void ts_free_variant(TS_Variant variant, TS_Allocator *allocator)
+{
+    TS_Allocator heap;
+    if (!allocator)
+    {
+        heap = ts_get_stdlib_allocator();
+        allocator = &heap;
+    }
+    if ((variant.type == TS_Variant_Array || variant.type == TS_Variant_Dictionary) && variant.array.items)
+    {
+        allocator->free(variant.array.items, allocator->ctx);
+    }
+}
+
+/* Packed arrays */
+
+#if !defined(TS_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define TS_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+typedef struct
+{
+    TS_Str name;
+    TS_Packed_Type type;
+    int components; // scalars per element
+    int size;       // bytes per element
+} TS_Packed_Kind;
+
+static const TS_Packed_Kind ts_packed_kinds[] = {
+    { {"PackedByteArray",    15}, TS_Packed_Byte,    1, 1 },
+    { {"PackedInt32Array",   16}, TS_Packed_Int32,   1, 4 },
+    { {"PackedInt64Array",   16}, TS_Packed_Int64,   1, 8 },
+    { {"PackedFloat32Array", 18}, TS_Packed_Float32, 1, 4 },
+    { {"PackedFloat64Array", 18}, TS_Packed_Float64, 1, 8 },
+    { {"PackedVector2Array", 18}, TS_Packed_Vector2, 2, 8 },
+    { {"PackedVector3Array", 18}, TS_Packed_Vector3, 3, 12 },
+    { {"PackedVector4Array", 18}, TS_Packed_Vector4, 4, 16 },
+    { {"PackedColorArray",   16}, TS_Packed_Color,   4, 16 },
+    // Godot 3 spellings
+    { {"PoolByteArray",      13}, TS_Packed_Byte,    1, 1 },
+    { {"PoolIntArray",       12}, TS_Packed_Int32,   1, 4 },
+    { {"PoolRealArray",      13}, TS_Packed_Float32, 1, 4 },
+    { {"PoolVector2Array",   16}, TS_Packed_Vector2, 2, 8 },
+    { {"PoolVector3Array",   16}, TS_Packed_Vector3, 3, 12 },
+    { {"PoolColorArray",     14}, TS_Packed_Color,   4, 16 },
+};
+
+static int ts_ctz64(uint64_t mask)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+#if defined(_M_X64) || defined(_M_ARM64)
+    _BitScanForward64(&index, mask);
+#else
+    if (!_BitScanForward(&index, (unsigned long) mask))
+    {
+        _BitScanForward(&index, (unsigned long)(mask >> 32));
+        index += 32;
+    }
+#endif
+    return (int) index;
+#else
+    return __builtin_ctzll(mask);
+#endif
+}
+
+static ptrdiff_t ts_count_byte(char *at, char *end, char c)
+{
+    ptrdiff_t count = 0;
+#ifdef TS_SIMD_SSE2
+    // Byte lanes count down by one per match, summed before any lane can wrap
+    __m128i needle = _mm_set1_epi8(c);
+    while (end - at >= 16)
+    {
+        __m128i lanes = _mm_setzero_si128();
+        for (int i = 0; i < 255 && end - at >= 16; i++, at += 16)
+        {
+            __m128i chunk = _mm_loadu_si128((__m128i *) at);
+            lanes = _mm_sub_epi8(lanes, _mm_cmpeq_epi8(chunk, needle));
+        }
+        __m128i sums = _mm_sad_epu8(lanes, _mm_setzero_si128());
+        count += _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+    }
+#endif
+    for (; at < end; at++)
+    {
+        count += *at == c;
+    }
+    return count;
+}
+
+// SWAR digit parsing, eight characters per step. The first character sits in
+// the lowest byte, which assumes a little endian target like every one we ship.
+static const uint64_t ts_pow10_u64[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+};
+
+static int ts_digit_run(uint64_t v)
+{
+    uint64_t nondigit = ((v + 0x4646464646464646ull) | (v - 0x3030303030303030ull)) & 0x8080808080808080ull;
+    return nondigit ? ts_ctz64(nondigit) >> 3 : 8;
+}
+
+// All eight bytes must be digits, shifting in zero bytes reads as leading zeros
+static uint64_t ts_eight_digits(uint64_t v)
+{
+    v = (v & 0x0f0f0f0f0f0f0f0full) * 2561 >> 8;
+    v = (v & 0x00ff00ff00ff00ffull) * 6553601 >> 16;
+    return (v & 0x0000ffff0000ffffull) * 42949672960001ull >> 32;
+}
+
+static char *ts_digits(char *at, char *end, uint64_t *mantissa, int *digits)
+{
+    while (end - at >= 8)
+    {
+        uint64_t v;
+        memcpy(&v, at, 8);
+        int n = ts_digit_run(v);
+        if (!n)
+        {
+            return at;
+        }
+        *mantissa = *mantissa * ts_pow10_u64[n] + ts_eight_digits(v << (64 - 8*n));
+        *digits += n;
+        at += n;
+        if (n < 8)
+        {
+            return at;
+        }
+    }
+    for (; at < end && ts_is_digit(*at); at++)
+    {
+        *mantissa = *mantissa * 10 + (*at - '0');
+        *digits += 1;
+    }
+    return at;
+}
+
+// Plain decimals take the SWAR path, anything unusual goes through ts_parse_number
+static _Bool ts_packed_number(char **at, char *end, TS_Variant *out)
+{
+    char *p = *at;
+    _Bool negative = 0;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p++ == '-';
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    p = ts_digits(p, end, &mantissa, &digits);
+
+    _Bool is_float = 0;
+    int exponent = 0;
+    if (p < end && *p == '.')
+    {
+        char *fraction = ++p;
+        p = ts_digits(p, end, &mantissa, &digits);
+        exponent = (int)(fraction - p);
+        is_float = 1;
+    }
+
+    _Bool simple = digits && digits <= 18 && !(p < end && (*p == 'e' || *p == 'E' || ts_is_ident(*p)));
+    if (simple && !is_float)
+    {
+        out->type    = TS_Variant_Int;
+        out->integer = negative ? -(int64_t) mantissa : (int64_t) mantissa;
+        *at = p;
+        return 1;
+    }
+    if (simple && mantissa <= (uint64_t) 1 << 53 && exponent >= -22)
+    {
+        double value = (double) mantissa / ts_pow10[-exponent];
+        out->type = TS_Variant_Float;
+        out->real = negative ? -value : value;
+        *at = p;
+        return 1;
+    }
+
+    TS_Variant_Parser parser = {0};
+    parser.at  = *at;
+    parser.end = end;
+    if (!ts_parse_number(&parser, out))
+    {
+        return 0;
+    }
+    *at = parser.at;
+    return 1;
+}
+
+static const TS_Packed_Kind *ts_packed_kind(TS_Str value, TS_Str *args)
+{
+    value = trimright(trimleft(value));
+    TS_Cut call = cut(value, '(');
+    if (!call.ok || !value.len || value.data[value.len - 1] != ')')
+    {
+        return 0;
+    }
+
+    TS_Str name = trimright(call.head);
+    for (int i = 0; i < (int)(sizeof(ts_packed_kinds) / sizeof(ts_packed_kinds[0])); i++)
+    {
+        if (ts_equals(ts_packed_kinds[i].name, name))
+        {
+            *args = trimright(trimleft(U(call.tail.data, call.tail.len - 1)));
+            return &ts_packed_kinds[i];
+        }
+    }
+    return 0;
+}
+
+// Godot 4.3 and later write byte arrays as one base64 string
+static int ts_base64_value(char c)
+{
+    return c >= 'A' && c <= 'Z' ? c - 'A'
+         : c >= 'a' && c <= 'z' ? c - 'a' + 26
+         : c >= '0' && c <= '9' ? c - '0' + 52
+         : c == '+' ? 62
+         : c == '/' ? 63
+         : -1;
+}
+
+static ptrdiff_t ts_base64_len(TS_Str encoded)
+{
+    ptrdiff_t len = encoded.len;
+    while (len && encoded.data[len - 1] == '=')
+    {
+        len--;
+    }
+    return len * 3 / 4;
+}
+
+TS_Packed_Info ts_packed_info(char *value, ptrdiff_t value_len)
+{
+    TS_Packed_Info info = {0};
+
+    TS_Str args = {0};
+    const TS_Packed_Kind *kind = ts_packed_kind(U(value, value_len), &args);
+    if (!kind)
+    {
+        return info;
+    }
+
+    ptrdiff_t scalars = 0;
+    if (kind->type == TS_Packed_Byte && args.len >= 2 && args.data[0] == '"' && args.data[args.len - 1] == '"')
+    {
+        scalars = ts_base64_len(U(args.data + 1, args.len - 2));
+    }
+    else if (args.len)
+    {
+        scalars = ts_count_byte(args.data, args.data + args.len, ',') + 1;
+    }
+
+    if (scalars % kind->components)
+    {
+        return info;
+    }
+
+    info.ok   = 1;
+    info.type = kind->type;
+    info.len  = scalars / kind->components;
+    info.size = info.len * kind->size;
+    return info;
+}
+
+_Bool ts_decode_packed(char *value, ptrdiff_t value_len, void *out, ptrdiff_t out_size)
+{
+    TS_Str args = {0};
+    const TS_Packed_Kind *kind = ts_packed_kind(U(value, value_len), &args);
+    TS_Packed_Info info = ts_packed_info(value, value_len);
+    if (!kind || !info.ok || out_size < info.size)
+    {
+        return 0;
+    }
+
+    if (kind->type == TS_Packed_Byte && args.len >= 2 && args.data[0] == '"')
+    {
+        unsigned char *bytes = out;
+        uint32_t bits = 0;
+        int pending = 0;
+        ptrdiff_t written = 0;
+        for (ptrdiff_t i = 1; i < args.len - 1 && args.data[i] != '='; i++)
+        {
+            int sextet = ts_base64_value(args.data[i]);
+            if (sextet < 0)
+            {
+                return 0;
+            }
+            bits = bits << 6 | (uint32_t) sextet;
+            pending += 6;
+            if (pending >= 8)
+            {
+                pending -= 8;
+                bytes[written++] = (unsigned char)(bits >> pending);
+            }
+        }
+        return written == info.len;
+    }
+
+    char *at  = args.data;
+    char *end = args.data + args.len;
+    ptrdiff_t scalars = info.len * kind->components;
+    for (ptrdiff_t i = 0; i < scalars; i++)
+    {
+        while (at < end && *at == ' ')
+        {
+            at++;
+        }
+
+        TS_Variant number;
+        if (!ts_packed_number(&at, end, &number))
+        {
+            return 0;
+        }
+        double real = number.type == TS_Variant_Int ? (double) number.integer : number.real;
+
+        switch (kind->type)
+        {
+        case TS_Packed_Byte:
+            if (number.type != TS_Variant_Int || number.integer < 0 || number.integer > 255) return 0;
+            ((uint8_t *) out)[i] = (uint8_t) number.integer;
+            break;
+        case TS_Packed_Int32:
+            if (number.type != TS_Variant_Int || number.integer < INT32_MIN || number.integer > INT32_MAX) return 0;
+            ((int32_t *) out)[i] = (int32_t) number.integer;
+            break;
+        case TS_Packed_Int64:
+            if (number.type != TS_Variant_Int) return 0;
+            ((int64_t *) out)[i] = number.integer;
+            break;
+        case TS_Packed_Float64:
+            ((double *) out)[i] = real;
+            break;
+        default: // Float32 and the float vectors are all runs of floats
+            ((float *) out)[i] = (float) real;
+            break;
+        }
+
+        while (at < end && *at == ' ')
+        {
+            at++;
+        }
+        if (i + 1 < scalars && (at == end || *at++ != ','))
+        {
+            return 0;
+        }
+    }
+    return at == end;
+}
+
+/* Loading */
+
+// Pairs are parsed without unescaping so `raw` keeps the text as written. A
+// writable load then moves that text to `blocks` and unescapes the value in place.
+// `line_end` bounds the span of a quoted value that was never closed.
+static _Bool ts_load_pair(TS_Pair *pair, char *line_end, _Bool read_only, TS_Block **blocks, TS_Allocator *allocator)
+{
+    ptrdiff_t quoted = (pair->flags & TS_Pair_Quoted) != 0;
+    char *span_end = pair->value.data + pair->value.len + quoted;
+    pair->span.data = pair->value.data - quoted;
+    pair->span.len  = (span_end < line_end ? span_end : line_end) - pair->span.data;
+
+    pair->raw.data = pair->value.data;
+    pair->raw.len  = pair->value.len;
+    if (read_only || !(pair->flags & TS_Pair_Escaped))
+    {
+        return 1;
+    }
+
+    char *copy = ts_block_alloc(blocks, allocator, pair->value.len, 1, 1);
+    if (!copy)
+    {
+        return 0;
+    }
+    memcpy(copy, pair->value.data, pair->value.len);
+    pair->raw.data   = copy;
+    pair->value.len  = ts_unescape(pair->value.data, pair->value.len);
+    pair->flags     &= ~TS_Pair_Escaped;
+    return 1;
+}
+
+static _Bool ts_load_decode(TS_Buffer *values, TS_Block **blocks, TS_Allocator *allocator, TS_Pair pair)
+{
+    TS_Variant *value = push(values, allocator, TS_Variant);
+    if (!value)
+    {
+        return 0;
+    }
+
+    // A value that fails to decode stays Raw, only running out of memory stops the load
+    _Bool out_of_memory = 0;
+    *value = ts_decode(U(pair.value.data, pair.value.len), pair.flags & TS_Pair_Quoted, allocator, blocks, &out_of_memory).variant;
+    return !out_of_memory;
+}
+
+_Bool ts_unescape_pair(TS_Load_Result *result, TS_Pair *pair, TS_Allocator *allocator)
+{
+    if (!(pair->flags & TS_Pair_Escaped))
+    {
+        return 1;
+    }
+
+    TS_Allocator heap;
+    if (!allocator)
+    {
+        heap = ts_get_stdlib_allocator();
+        allocator = &heap;
+    }
+
+    TS_Block *blocks = result->arena;
+    char *copy = ts_block_alloc(&blocks, allocator, pair->value.len, 1, 1);
+    if (!copy)
+    {
+        return 0;
+    }
+    result->arena = blocks;
+
+    memcpy(copy, pair->value.data, pair->value.len);
+    pair->value.data = copy;
+    pair->value.len  = ts_unescape(copy, pair->value.len);
+    pair->flags &= ~TS_Pair_Escaped;
+    return 1;
+}
+
+/* Property lookup */
+
+#define TS_FNV_OFFSET 0xcbf29ce484222325ull
+#define TS_FNV_PRIME  0x100000001b3ull
+
+// FNV-1a runs byte by byte, so a child's path hash continues from its parent's
+static uint64_t ts_hash(uint64_t h, TS_Str s)
+{
+    for (ptrdiff_t i = 0; i < s.len; i++)
+    {
+        h ^= (unsigned char) s.data[i];
+        h *= TS_FNV_PRIME;
+    }
+    return h;
+}
+
+// Every lookup table here is open addressed: a power of two of slots probed
+// linearly from the hash, 0 for an empty slot. Key maps hold int32_t entries
+// to keep the cache small, the rest hold ptrdiff_t.
+typedef struct
+{
+    void *slots;
+    ptrdiff_t cap;
+    _Bool narrow; // int32_t slots
+} TS_Table;
+
+// Whether a stored entry holds the key being looked up
+typedef _Bool TS_Table_Match(void *ctx, ptrdiff_t entry);
+
+static ptrdiff_t ts_table_slot(TS_Table table, ptrdiff_t i)
+{
+    return table.narrow ? ((int32_t *) table.slots)[i] : ((ptrdiff_t *) table.slots)[i];
+}
+
+// The first entry on the probe sequence that `match` accepts, 0 when there is none
+static ptrdiff_t ts_table_find(TS_Table table, uint64_t hash, TS_Table_Match *match, void *ctx)
+{
+    if (!table.cap)
+    {
+        return 0;
+    }
+
+    ptrdiff_t mask = table.cap - 1;
+    for (ptrdiff_t i = (ptrdiff_t)(hash & mask);; i = (i + 1) & mask)
+    {
+        ptrdiff_t entry = ts_table_slot(table, i);
+        if (!entry || match(ctx, entry))
+        {
+            return entry;
+        }
+    }
+}
+
+// Stores a nonzero entry in the first empty slot, callers size tables to always have one
+static void ts_table_insert(TS_Table table, uint64_t hash, ptrdiff_t entry)
+{
+    ptrdiff_t mask = table.cap - 1;
+    ptrdiff_t i = (ptrdiff_t)(hash & mask);
+    while (ts_table_slot(table, i))
+    {
+        i = (i + 1) & mask;
+    }
+
+    if (table.narrow)
+    {
+        ((int32_t *) table.slots)[i] = (int32_t) entry;
+    }
+    else
+    {
+        ((ptrdiff_t *) table.slots)[i] = entry;
+    }
+}
+
+#ifndef TS_KEY_MAP_MIN
+#define TS_KEY_MAP_MIN 8 // fewer keys than this are scanned, which is as fast
+#endif
+
+// Heading pairs and pairs share one table per chunk, heading keys are hashed from a different seed
+static uint64_t ts_key_hash(_Bool heading, TS_Str key)
+{
+    return ts_hash(TS_FNV_OFFSET ^ heading, key);
+}
+
+typedef struct
+{
+    TS_Pair *pairs;
+    _Bool heading;
+    TS_Str key;
+} TS_Key_Match;
+
+// Entries are pair index + 1, or -(heading pair index + 1)
+static _Bool ts_key_match(void *ctx, ptrdiff_t entry)
+{
+    TS_Key_Match *m = ctx;
+    if ((entry < 0) != m->heading)
+    {
+        return 0;
+    }
+    TS_Pair *pair = &m->pairs[(entry < 0 ? -entry : entry) - 1];
+    return ts_equals(U(pair->key.data, pair->key.len), m->key);
+}
+
+static TS_Pair *ts_chunk_lookup(TS_Chunk *chunk, _Bool heading, TS_Str key)
+{
+    TS_Pair *pairs = heading ? chunk->heading_pairs : chunk->pairs;
+    ptrdiff_t len  = heading ? chunk->heading_pairs_len : chunk->pairs_len;
+    if (!chunk->key_map)
+    {
+        for (ptrdiff_t i = 0; i < len; i++)
+        {
+            if (ts_equals(U(pairs[i].key.data, pairs[i].key.len), key))
+            {
+                return &pairs[i];
+            }
+        }
+        return 0;
+    }
+
+    TS_Table table = { chunk->key_map, chunk->key_map_cap, 1 };
+    TS_Key_Match match = { pairs, heading, key };
+    ptrdiff_t entry = ts_table_find(table, ts_key_hash(heading, key), ts_key_match, &match);
+    return entry ? &pairs[(entry < 0 ? -entry : entry) - 1] : 0;
+}
+
+TS_Pair *ts_chunk_get(TS_Chunk *chunk, char *key, ptrdiff_t key_len)
+{
+    return ts_chunk_lookup(chunk, 0, U(key, key_len));
+}
+
+TS_Pair *ts_chunk_heading_get(TS_Chunk *chunk, char *key, ptrdiff_t key_len)
+{
+    return ts_chunk_lookup(chunk, 1, U(key, key_len));
+}
+
+// All the tables live in result->key_maps. A repeated key keeps its first pair,
+// as a scan would find it.
+static _Bool ts_build_key_maps(TS_Load_Result *result, TS_Allocator *allocator)
+{
+    ptrdiff_t total = 0;
+    for (ptrdiff_t i = 0; i < result->chunks_len; i++)
+    {
+        TS_Chunk *chunk = &result->chunks[i];
+        ptrdiff_t keys = chunk->heading_pairs_len + chunk->pairs_len;
+        if (keys >= TS_KEY_MAP_MIN)
+        {
+            ptrdiff_t cap = 16;
+            while (cap < keys * 2)
+            {
+                cap *= 2;
+            }
+            chunk->key_map_cap = cap;
+            total += cap;
+        }
+    }
+    if (!total)
+    {
+        return 1;
+    }
+
+    result->key_maps = allocator->malloc(total * (ptrdiff_t) sizeof(int32_t), allocator->ctx);
+    if (!result->key_maps)
+    {
+        return 0;
+    }
+    memset(result->key_maps, 0, total * sizeof(int32_t));
+    result->key_maps_len = total;
+
+    int32_t *next = result->key_maps;
+    for (ptrdiff_t i = 0; i < result->chunks_len; i++)
+    {
+        TS_Chunk *chunk = &result->chunks[i];
+        if (!chunk->key_map_cap)
+        {
+            continue;
+        }
+
+        // The duplicate check probes the table while it is being filled
+        chunk->key_map = next;
+        next += chunk->key_map_cap;
+        TS_Table table = { chunk->key_map, chunk->key_map_cap, 1 };
+        for (int heading = 1; heading >= 0; heading--)
+        {
+            TS_Pair *pairs = heading ? chunk->heading_pairs : chunk->pairs;
+            ptrdiff_t len  = heading ? chunk->heading_pairs_len : chunk->pairs_len;
+            for (ptrdiff_t p = 0; p < len; p++)
+            {
+                TS_Str key = U(pairs[p].key.data, pairs[p].key.len);
+                if (ts_chunk_lookup(chunk, (_Bool) heading, key))
+                {
+                    continue;
+                }
+
+                ts_table_insert(table, ts_key_hash((_Bool) heading, key), heading ? -(p + 1) : p + 1);
+            }
+        }
+    }
+    return 1;
+}
+
+/* Node tree */
+
+static TS_Str ts_heading_value(TS_Chunk *chunk, TS_Str key)
+{
+    TS_Pair *pair = ts_chunk_lookup(chunk, 1, key);
+    return pair ? U(pair->value.data, pair->value.len) : (TS_Str) {0};
+}
+
+// Walks up from `node` matching one name per path segment, hashes can collide
+static _Bool ts_node_has_path(TS_Node *nodes, ptrdiff_t node, TS_Str path)
+{
+    if (node == 0)
+    {
+        return ts_equals(path, S("."));
+    }
+
+    for (;;)
+    {
+        TS_Str name = U(nodes[node].name.data, nodes[node].name.len);
+        if (path.len < name.len || !ts_equals(U(path.data + path.len - name.len, name.len), name))
+        {
+            return 0;
+        }
+        path.len -= name.len;
+
+        node = nodes[node].parent;
+        if (node == 0)
+        {
+            return path.len == 0;
+        }
+        if (node < 0 || !path.len || path.data[path.len - 1] != '/')
+        {
+            return 0;
+        }
+        path.len -= 1;
+    }
+}
+
+typedef struct
+{
+    TS_Node *nodes;
+    uint64_t hash;
+    TS_Str path;
+} TS_Node_Match;
+
+static _Bool ts_node_match(void *ctx, ptrdiff_t entry)
+{
+    TS_Node_Match *m = ctx;
+    return m->nodes[entry - 1].path_hash == m->hash && ts_node_has_path(m->nodes, entry - 1, m->path);
+}
+
+static ptrdiff_t ts_node_lookup(TS_Load_Result *result, uint64_t hash, TS_Str path)
+{
+    TS_Table table = { result->node_map, result->node_map_cap, 0 };
+    TS_Node_Match match = { result->nodes, hash, path };
+    return ts_table_find(table, hash, ts_node_match, &match) - 1;
+}
+
+ptrdiff_t ts_find_node(TS_Load_Result *result, char *path, ptrdiff_t path_len)
+{
+    TS_Str s = U(path, path_len);
+    return ts_node_lookup(result, ts_hash(TS_FNV_OFFSET, s), s);
+}
+
+// Parents always come before their children in a .tscn, so one forward pass
+// resolves every parent through the map, and one backward pass links siblings
+// in file order by prepending.
+static _Bool ts_build_node_tree(TS_Load_Result *result, TS_Allocator *allocator)
+{
+    ptrdiff_t len = 0;
+    for (ptrdiff_t i = 0; i < result->chunks_len; i++)
+    {
+        len += result->chunks[i].heading == TS_Heading_Node;
+    }
+    if (!len)
+    {
+        return 1;
+    }
+
+    ptrdiff_t cap = 16;
+    while (cap < len * 2)
+    {
+        cap *= 2;
+    }
+
+    result->nodes    = allocator->malloc(len * (ptrdiff_t) sizeof(TS_Node), allocator->ctx);
+    result->node_map = allocator->malloc(cap * (ptrdiff_t) sizeof(ptrdiff_t), allocator->ctx);
+    if (!result->nodes || !result->node_map)
+    {
+        if (result->nodes) allocator->free(result->nodes, allocator->ctx);
+        if (result->node_map) allocator->free(result->node_map, allocator->ctx);
+        result->nodes    = 0;
+        result->node_map = 0;
+        return 0;
+    }
+    memset(result->node_map, 0, cap * sizeof(ptrdiff_t));
+    result->nodes_len    = len;
+    result->node_map_cap = cap;
+
+    TS_Node *nodes = result->nodes;
+    ptrdiff_t n = 0;
+    for (ptrdiff_t i = 0; i < result->chunks_len; i++)
+    {
+        TS_Chunk *chunk = &result->chunks[i];
+        if (chunk->heading != TS_Heading_Node)
+        {
+            continue;
+        }
+
+        TS_Node *node = &nodes[n];
+        TS_Str name   = ts_heading_value(chunk, S("name"));
+        TS_Str parent = ts_heading_value(chunk, S("parent"));
+        node->chunk        = i;
+        node->parent       = -1;
+        node->first_child  = -1;
+        node->next_sibling = -1;
+        node->name.data    = name.data;
+        node->name.len     = name.len;
+
+        _Bool linked = 0;
+        if (n == 0)
+        {
+            node->path_hash = ts_hash(TS_FNV_OFFSET, S("."));
+            linked = 1;
+        }
+        else if (parent.data)
+        {
+            node->parent = ts_equals(parent, S("."))
+                ? 0
+                : ts_node_lookup(result, ts_hash(TS_FNV_OFFSET, parent), parent);
+
+            if (node->parent == 0)
+            {
+                node->path_hash = ts_hash(TS_FNV_OFFSET, name);
+                linked = 1;
+            }
+            else if (node->parent > 0)
+            {
+                node->path_hash = ts_hash(ts_hash(nodes[node->parent].path_hash, S("/")), name);
+                linked = 1;
+            }
+        }
+
+        // Nodes under an instanced scene's children can't be resolved, they stay orphans
+        if (linked)
+        {
+            ts_table_insert((TS_Table) { result->node_map, cap, 0 }, node->path_hash, n + 1);
+        }
+        n++;
+    }
+
+    for (ptrdiff_t i = len - 1; i > 0; i--)
+    {
+        ptrdiff_t parent = nodes[i].parent;
+        if (parent >= 0)
+        {
+            nodes[i].next_sibling = nodes[parent].first_child;
+            nodes[parent].first_child = i;
+        }
+    }
+    return 1;
+}
+
+/* Resources */
+
+typedef struct
+{
+    TS_Load_Result *result;
+    _Bool ext;
+    TS_Str id;
+} TS_Resource_Match;
+
+// Entries are ext index + 1, or -(sub index + 1)
+static _Bool ts_resource_match(void *ctx, ptrdiff_t entry)
+{
+    TS_Resource_Match *m = ctx;
+    if ((entry > 0) != m->ext)
+    {
+        return 0;
+    }
+    TS_Resource *resource = m->ext ? &m->result->ext_resources[entry - 1] : &m->result->sub_resources[-entry - 1];
+    return ts_equals(U(resource->id.data, resource->id.len), m->id);
+}
+
+static ptrdiff_t ts_resource_lookup(TS_Load_Result *result, TS_Heading heading, TS_Str id)
+{
+    _Bool ext = heading == TS_Heading_Ext_Resource;
+    TS_Table table = { result->resource_map, result->resource_map_cap, 0 };
+    TS_Resource_Match match = { result, ext, id };
+    ptrdiff_t entry = ts_table_find(table, ts_hash(TS_FNV_OFFSET ^ ext, id), ts_resource_match, &match);
+    return !entry ? -1 : ext ? entry - 1 : -entry - 1;
+}
+
+ptrdiff_t ts_find_resource(TS_Load_Result *result, TS_Heading heading, char *id, ptrdiff_t id_len)
+{
+    return ts_resource_lookup(result, heading, U(id, id_len));
+}
+
+static void ts_resolve_variant(TS_Load_Result *result, TS_Variant *v)
+{
+    switch (v->type)
+    {
+    case TS_Variant_Ext_Resource:
+        v->resource.index = (int32_t) ts_resource_lookup(result, TS_Heading_Ext_Resource, U(v->resource.data, v->resource.len));
+        break;
+    case TS_Variant_Sub_Resource:
+        v->resource.index = (int32_t) ts_resource_lookup(result, TS_Heading_Sub_Resource, U(v->resource.data, v->resource.len));
+        break;
+    case TS_Variant_Array:
+    case TS_Variant_Dictionary:
+    {
+        ptrdiff_t items = v->type == TS_Variant_Dictionary ? v->array.len * 2 : v->array.len;
+        for (ptrdiff_t i = 0; i < items; i++)
+        {
+            ts_resolve_variant(result, &v->array.items[i]);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// Dense tables for both resource kinds, then every pair whose value is a bare
+// ExtResource(...) or SubResource(...) gets its handle so instancing never
+// compares id strings. Decoded values also get indices for the references
+// nested in their arrays and dictionaries.
+static _Bool ts_resolve_resources(TS_Load_Result *result, TS_Allocator *allocator)
+{
+    ptrdiff_t ext_len = 0;
+    ptrdiff_t sub_len = 0;
+    for (ptrdiff_t i = 0; i < result->chunks_len; i++)
+    {
+        ext_len += result->chunks[i].heading == TS_Heading_Ext_Resource;
+        sub_len += result->chunks[i].heading == TS_Heading_Sub_Resource;
+    }
+
+    ptrdiff_t cap = 16;
+    while (cap < (ext_len + sub_len) * 2)
+    {
+        cap *= 2;
+    }
+
+    if (result->all_pairs_len)
+    {
+        result->resource_handles = allocator->malloc(result->all_pairs_len * (ptrdiff_t) sizeof(TS_Resource_Handle), allocator->ctx);
+        if (!result->resource_handles)
+        {
+            return 0;
+        }
+    }
+    if (ext_len + sub_len)
+    {
+        result->ext_resources = ext_len ? allocator->malloc(ext_len * (ptrdiff_t) sizeof(TS_Resource), allocator->ctx) : 0;
+        result->sub_resources = sub_len ? allocator->malloc(sub_len * (ptrdiff_t) sizeof(TS_Resource), allocator->ctx) : 0;
+        result->resource_map  = allocator->malloc(cap * (ptrdiff_t) sizeof(ptrdiff_t), allocator->ctx);
+        if ((ext_len && !result->ext_resources) || (sub_len && !result->sub_resources) || !result->resource_map)
+        {
+            return 0;
+        }
+        memset(result->resource_map, 0, cap * sizeof(ptrdiff_t));
+        result->resource_map_cap = cap;
+    }
+
+    for (ptrdiff_t i = 0; i < result->chunks_len; i++)
+    {
+        TS_Chunk *chunk = &result->chunks[i];
+        _Bool ext = chunk->heading == TS_Heading_Ext_Resource;
+        if (!ext && chunk->heading != TS_Heading_Sub_Resource)
+        {
+            continue;
+        }
+
+        TS_Str id = ts_heading_value(chunk, S("id"));
+        TS_Resource *resource = ext
+            ? &result->ext_resources[result->ext_resources_len++]
+            : &result->sub_resources[result->sub_resources_len++];
+        resource->chunk   = i;
+        resource->id.data = id.data;
+        resource->id.len  = id.len;
+
+        TS_Table table = { result->resource_map, cap, 0 };
+        ts_table_insert(table, ts_hash(TS_FNV_OFFSET ^ ext, id), ext ? result->ext_resources_len : -result->sub_resources_len);
+    }
+
+    for (ptrdiff_t i = 0; i < result->all_pairs_len; i++)
+    {
+        TS_Pair *pair = &result->all_pairs[i];
+        TS_Resource_Handle *handle = &result->resource_handles[i];
+        handle->heading = TS_Heading_Nothing;
+        handle->index   = -1;
+
+        char first = pair->value.len ? pair->value.data[0] : 0;
+        if ((pair->flags & TS_Pair_Quoted) || (first != 'E' && first != 'S'))
+        {
+            continue;
+        }
+
+        TS_Variant reference;
+        TS_Variant_Parser parser = {0};
+        parser.at  = pair->value.data;
+        parser.end = pair->value.data + pair->value.len;
+        ts_parse_variant(&parser, &reference);
+        if (parser.error || (reference.type != TS_Variant_Ext_Resource && reference.type != TS_Variant_Sub_Resource))
+        {
+            continue;
+        }
+
+        handle->heading = reference.type == TS_Variant_Ext_Resource ? TS_Heading_Ext_Resource : TS_Heading_Sub_Resource;
+        handle->index   = (int) ts_resource_lookup(result, handle->heading, U(reference.string.data, reference.string.len));
+    }
+
+    for (ptrdiff_t i = 0; result->values && i < result->all_pairs_len; i++)
+    {
+        ts_resolve_variant(result, &result->values[i]);
+    }
+    return 1;
+}
+
+/* Connections */
+
+typedef struct
+{
+    TS_Name *names;
+    TS_Str name;
+} TS_Name_Match;
+
+static _Bool ts_name_match(void *ctx, ptrdiff_t entry)
+{
+    TS_Name_Match *m = ctx;
+    return ts_equals(U(m->names[entry - 1].data, m->names[entry - 1].len), m->name);
+}
+
+static ptrdiff_t ts_name_lookup(TS_Load_Result *result, TS_Str name)
+{
+    TS_Table table = { result->name_map, result->name_map_cap, 0 };
+    TS_Name_Match match = { result->names, name };
+    return ts_table_find(table, ts_hash(TS_FNV_OFFSET, name), ts_name_match, &match) - 1;
+}
+
+ptrdiff_t ts_find_name(TS_Load_Result *result, char *name, ptrdiff_t name_len)
+{
+    return ts_name_lookup(result, U(name, name_len));
+}
+
+// `names` and `name_map` are sized for every name up front
+static int32_t ts_intern(TS_Load_Result *result, TS_Str name)
+{
+    TS_Table table = { result->name_map, result->name_map_cap, 0 };
+    TS_Name_Match match = { result->names, name };
+    uint64_t hash = ts_hash(TS_FNV_OFFSET, name);
+    ptrdiff_t entry = ts_table_find(table, hash, ts_name_match, &match);
+    if (entry)
+    {
+        return (int32_t)(entry - 1);
+    }
+
+    TS_Name *interned = &result->names[result->names_len++];
+    interned->data = name.data;
+    interned->len  = name.len;
+    ts_table_insert(table, hash, result->names_len);
+    return (int32_t)(result->names_len - 1);
+}
+
+static _Bool ts_connection_before(TS_Connection *a, TS_Connection *b)
+{
+    return a->from != b->from ? a->from < b->from : a->signal < b->signal;
+}
+
+// Bottom up merge sort, stable so connections on one signal keep file order,
+// which is the order Godot calls them in
+static void ts_sort_connections(TS_Connection *items, TS_Connection *scratch, ptrdiff_t len)
+{
+    for (ptrdiff_t width = 1; width < len; width *= 2)
+    {
+        for (ptrdiff_t lo = 0; lo < len; lo += 2 * width)
+        {
+            ptrdiff_t mid = lo + width < len ? lo + width : len;
+            ptrdiff_t hi  = lo + 2 * width < len ? lo + 2 * width : len;
+            ptrdiff_t a = lo, b = mid, out = lo;
+            while (a < mid && b < hi)
+            {
+                scratch[out++] = ts_connection_before(&items[b], &items[a]) ? items[b++] : items[a++];
+            }
+            while (a < mid) scratch[out++] = items[a++];
+            while (b < hi)  scratch[out++] = items[b++];
+        }
+        memcpy(items, scratch, len * sizeof(TS_Connection));
+    }
+}
+
+// Connections whose ends are both nodes of this scene, sorted by source then
+// signal, with a range per source node so emitting is a lookup and a short scan
+static _Bool ts_build_connections(TS_Load_Result *result, TS_Allocator *allocator)
+{
+    ptrdiff_t len = 0;
+    for (ptrdiff_t i = 0; i < result->chunks_len; i++)
+    {
+        len += result->chunks[i].heading == TS_Heading_Connection;
+    }
+    if (!len || !result->nodes_len)
+    {
+        return 1;
+    }
+
+    ptrdiff_t cap = 16;
+    while (cap < len * 4)
+    {
+        cap *= 2;
+    }
+
+    TS_Connection *scratch   = allocator->malloc(len * (ptrdiff_t) sizeof(TS_Connection), allocator->ctx);
+    result->connections      = allocator->malloc(len * (ptrdiff_t) sizeof(TS_Connection), allocator->ctx);
+    result->node_connections = allocator->malloc((result->nodes_len + 1) * (ptrdiff_t) sizeof(ptrdiff_t), allocator->ctx);
+    result->names            = allocator->malloc(len * 2 * (ptrdiff_t) sizeof(TS_Name), allocator->ctx);
+    result->name_map         = allocator->malloc(cap * (ptrdiff_t) sizeof(ptrdiff_t), allocator->ctx);
+    if (!scratch || !result->connections || !result->node_connections || !result->names || !result->name_map)
+    {
+        if (scratch) allocator->free(scratch, allocator->ctx);
+        return 0;
+    }
+    memset(result->name_map, 0, cap * sizeof(ptrdiff_t));
+    result->name_map_cap = cap;
+
+    for (ptrdiff_t i = 0; i < result->chunks_len; i++)
+    {
+        TS_Chunk *chunk = &result->chunks[i];
+        if (chunk->heading != TS_Heading_Connection)
+        {
+            continue;
+        }
+
+        TS_Str from = ts_heading_value(chunk, S("from"));
+        TS_Str to   = ts_heading_value(chunk, S("to"));
+        TS_Connection connection = {0};
+        connection.from  = (int32_t) ts_find_node(result, from.data, from.len);
+        connection.to    = (int32_t) ts_find_node(result, to.data, to.len);
+        connection.chunk = i;
+        if (connection.from < 0 || connection.to < 0)
+        {
+            continue;
+        }
+
+        connection.signal = ts_intern(result, ts_heading_value(chunk, S("signal")));
+        connection.method = ts_intern(result, ts_heading_value(chunk, S("method")));
+
+        TS_Str flags = ts_heading_value(chunk, S("flags"));
+        for (ptrdiff_t c = 0; c < flags.len && ts_is_digit(flags.data[c]); c++)
+        {
+            connection.flags = connection.flags * 10 + (flags.data[c] - '0');
+        }
+
+        result->connections[result->connections_len++] = connection;
+    }
+
+    ts_sort_connections(result->connections, scratch, result->connections_len);
+    allocator->free(scratch, allocator->ctx);
+
+    ptrdiff_t at = 0;
+    for (ptrdiff_t node = 0; node <= result->nodes_len; node++)
+    {
+        while (at < result->connections_len && result->connections[at].from < node)
+        {
+            at++;
+        }
+        result->node_connections[node] = at;
+    }
+    return 1;
+}
+
+TS_Connection_Range ts_find_connections(TS_Load_Result *result, ptrdiff_t node, ptrdiff_t signal)
+{
+    TS_Connection_Range range = {0};
+    if (!result->connections_len || node < 0 || node >= result->nodes_len)
+    {
+        return range;
+    }
+
+    ptrdiff_t at  = result->node_connections[node];
+    ptrdiff_t end = result->node_connections[node + 1];
+    while (at < end && result->connections[at].signal < signal)
+    {
+        at++;
+    }
+    range.connections = &result->connections[at];
+    for (; at < end && result->connections[at].signal == signal; at++)
+    {
+        range.len++;
+    }
+    return range;
+}
+
+TS_Load_Result ts_load(char *source)
+{
+    TS_Allocator allocator = ts_get_stdlib_allocator();
+    return ts_load1(source, strlen(source), &allocator);
+}
+
+TS_Load_Result ts_load1(char *source, ptrdiff_t source_len, TS_Allocator *allocator)
+{
+    return ts_load2(source, source_len, allocator, 0);
+}
+
+typedef struct
+{
+    ptrdiff_t chunks;
+    ptrdiff_t heading_pairs;
+    ptrdiff_t pairs;
+} TS_Load_Bounds;
+
+// Every chunk and pair starts a line and every heading pair takes one of its
+// line's '=', so counting those never comes up short
+static TS_Load_Bounds ts_load_bounds(char *source, ptrdiff_t source_len)
+{
+    TS_Load_Bounds bounds = {0};
+    char *end = source + source_len;
+    for (char *line = source; line < end;)
+    {
+        char *newline = memchr(line, '\n', end - line);
+        char *line_end = newline ? newline : end;
+        if (*line == '[')
+        {
+            bounds.chunks += 1;
+            for (char *at = line; (at = memchr(at, '=', line_end - at)); at++)
+            {
+                bounds.heading_pairs += 1;
+            }
+        }
+        else if (*line != '\n' && *line != ' ' && *line != '\r' && *line != '\t')
+        {
+            bounds.pairs += 1;
+        }
+        line = line_end + 1;
+    }
+    return bounds;
+}
+
+// Heading items and the items after them share one allocation, `tail` takes
+// the part past `heading_len` items so appending to either never moves them
+static _Bool ts_buffer_split(TS_Buffer *heading, TS_Buffer *tail, TS_Allocator *allocator,
+                             ptrdiff_t heading_len, ptrdiff_t tail_len, ptrdiff_t size)
+{
+    if (!heading_len && !tail_len)
+    {
+        return 1;
+    }
+
+    char *data = allocator->malloc((heading_len + tail_len) * size, allocator->ctx);
+    if (!data)
+    {
+        return 0;
+    }
+    *heading = (TS_Buffer) { data, 0, heading_len * size };
+    *tail    = (TS_Buffer) { data + heading_len * size, 0, tail_len * size };
+    return 1;
+}
+
+// Closes the gap ts_buffer_split left between the heading items and the tail
+static void ts_buffer_join(TS_Buffer *heading, TS_Buffer *tail)
+{
+    if (!tail->data)
+    {
+        return;
+    }
+    if (tail->len)
+    {
+        memmove(heading->data + heading->len, tail->data, tail->len);
+    }
+    heading->cap  = tail->data + tail->cap - heading->data;
+    heading->len += tail->len;
+    *tail = (TS_Buffer) {0};
+}
+
+// One forward pass over the source. Chunks, heading pairs and pairs are appended
+// to growable buffers, chunks only remember how many pairs they own and the
+// pointers are fixed up once every buffer has stopped moving. Decoded values
+// follow their pairs the same way, their nested items sit in blocks that never move.
+TS_Load_Result ts_load2(char *source, ptrdiff_t source_len, TS_Allocator *allocator, TS_Load_Flags flags)
+{
+    TS_Allocator heap;
+    if (!allocator)
+    {
+        heap = ts_get_stdlib_allocator();
+        allocator = &heap;
+    }
+
+    TS_Load_Result result = {0};
+
+    TS_Buffer chunks        = {0};
+    TS_Buffer heading_pairs = {0};
+    TS_Buffer pairs         = {0};
+    TS_Buffer heading_values = {0};
+    TS_Buffer values         = {0};
+    TS_Block *blocks = 0;
+    _Bool decode    = (flags & TS_Load_Decode_Values) != 0;
+    _Bool read_only = (flags & TS_Load_Read_Only) != 0;
+    _Bool out_of_memory = 0;
+
+    // An allocator that grows in place is an arena that cannot take back the
+    // copies buffers leave behind when they grow, so they are sized up front
+    _Bool presized = allocator->resize != 0;
+    if (presized)
+    {
+        TS_Load_Bounds bounds = ts_load_bounds(source, source_len);
+        ptrdiff_t chunks_size = bounds.chunks * (ptrdiff_t) sizeof(TS_Chunk);
+        chunks.data = chunks_size ? allocator->malloc(chunks_size, allocator->ctx) : 0;
+        chunks.cap  = chunks.data ? chunks_size : 0;
+
+        out_of_memory = (chunks_size && !chunks.data) ||
+                        !ts_buffer_split(&heading_pairs, &pairs, allocator, bounds.heading_pairs, bounds.pairs, sizeof(TS_Pair)) ||
+                        (decode && !ts_buffer_split(&heading_values, &values, allocator, bounds.heading_pairs, bounds.pairs, sizeof(TS_Variant)));
+    }
+
+    TS_Chunk *chunk = 0;
+    TS_Str rest = U(source, source_len);
+    while (rest.len && !out_of_memory)
+    {
+        // A pair ends at the first newline outside brackets and strings, so
+        // values spanning lines are found in the same forward pass
+        ptrdiff_t line_len;
+        if (chunk && rest.data[0] != '[')
+        {
+            TS_Line_Scan scan = {0};
+            line_len = ts_scan_line(&scan, rest.data, rest.len);
+        }
+        else
+        {
+            char *newline = memchr(rest.data, '\n', rest.len);
+            line_len = newline ? newline - rest.data + 1 : -1;
+        }
+        line_len = line_len < 0 ? rest.len : line_len;
+
+        TS_Str line = U(rest.data, line_len - (rest.data[line_len - 1] == '\n'));
+        rest = substring(rest, line_len);
+        if (!line.len)
+        {
+            continue;
+        }
+
+        char first = line.data[0];
+        if (first == '[')
+        {
+            // The previous chunk's text ends where this heading starts
+            TS_Chunk_Result heading = ts_heading_from_line(line);
+            char *text = chunk ? line.data : source;
+            if (chunk)
+            {
+                chunk->text.len = text - chunk->text.data;
+            }
+
+            chunk = push(&chunks, allocator, TS_Chunk);
+            if (!chunk)
+            {
+                out_of_memory = 1;
+                break;
+            }
+            *chunk = heading.chunk;
+            chunk->text.data = text;
+
+            // Heading pairs never leave the heading's line
+            TS_State heading_state = {0};
+            heading_state.current   = line;
+            heading_state.read_only = 1;
+            TS_Pair_Result current_pair;
+            while ((current_pair = ts_next_heading_pair(&heading_state)).ok)
+            {
+                TS_Pair *pair = push(&heading_pairs, allocator, TS_Pair);
+                if (!pair)
+                {
+                    out_of_memory = 1;
+                    break;
+                }
+                *pair = current_pair.pair;
+                chunk->heading_pairs_len += 1;
+
+                if (!ts_load_pair(pair, line.data + line.len, read_only, &blocks, allocator))
+                {
+                    out_of_memory = 1;
+                    break;
+                }
+                if (decode && !ts_load_decode(&heading_values, &blocks, allocator, *pair))
+                {
+                    out_of_memory = 1;
+                    break;
+                }
+
+                if (!heading_state.in_bracket)
+                {
+                    break;
+                }
+            }
+        }
+        else if (chunk && first != ' ' && first != '\r' && first != '\t')
+        {
+            TS_Pair *pair = push(&pairs, allocator, TS_Pair);
+            if (!pair)
+            {
+                out_of_memory = 1;
+                break;
+            }
+            *pair = ts_pair_from_line(line, 1).pair;
+            chunk->pairs_len += 1;
+
+            if (!ts_load_pair(pair, line.data + line.len, read_only, &blocks, allocator))
+            {
+                out_of_memory = 1;
+                break;
+            }
+            if (decode && !ts_load_decode(&values, &blocks, allocator, *pair))
+            {
+                out_of_memory = 1;
+                break;
+            }
+        }
+    }
+
+    if (chunk)
+    {
+        chunk->text.len = source + source_len - chunk->text.data;
+    }
+
+    // Same layout as before: every heading pair, then every pair
+    ptrdiff_t first_pair = heading_pairs.len / (ptrdiff_t) sizeof(TS_Pair);
+    if (presized)
+    {
+        ts_buffer_join(&heading_pairs, &pairs);
+        ts_buffer_join(&heading_values, &values);
+    }
+    if (!out_of_memory && pairs.len)
+    {
+        out_of_memory = !ts_buffer_append(&heading_pairs, allocator, pairs.data, pairs.len);
+    }
+    if (!out_of_memory && values.len)
+    {
+        out_of_memory = !ts_buffer_append(&heading_values, allocator, values.data, values.len);
+    }
+
+    if (!out_of_memory)
+    {
+        result.chunks        = (TS_Chunk *) chunks.data;
+        result.chunks_len    = chunks.len / (ptrdiff_t) sizeof(TS_Chunk);
+        result.all_pairs     = (TS_Pair *) heading_pairs.data;
+        result.all_pairs_len = heading_pairs.len / (ptrdiff_t) sizeof(TS_Pair);
+        result.values        = (TS_Variant *) heading_values.data;
+        result.arena         = blocks;
+
+        TS_Pair *next_heading_pair = result.all_pairs;
+        TS_Pair *next_pair         = result.all_pairs + first_pair;
+        for (ptrdiff_t i = 0; i < result.chunks_len; i++)
+        {
+            TS_Chunk *fixup = &result.chunks[i];
+            if (fixup->heading_pairs_len)
+            {
+                fixup->heading_pairs = next_heading_pair;
+                next_heading_pair += fixup->heading_pairs_len;
+            }
+            if (fixup->pairs_len)
+            {
+                fixup->pairs = next_pair;
+                next_pair += fixup->pairs_len;
+            }
+        }
+
+        out_of_memory = !ts_build_key_maps(&result, allocator) ||
+                        !ts_build_node_tree(&result, allocator) ||
+                        !ts_resolve_resources(&result, allocator) ||
+                        !ts_build_connections(&result, allocator);
+        result.ok = !out_of_memory;
+    }
+
+    if (out_of_memory)
+    {
+        void *tables[] = { result.key_maps, result.nodes, result.node_map, result.ext_resources, result.sub_resources,
+                           result.resource_handles, result.resource_map, result.connections, result.node_connections,
+                           result.names, result.name_map };
+        for (int i = 0; i < (int)(sizeof(tables) / sizeof(tables[0])); i++)
+        {
+            if (tables[i]) allocator->free(tables[i], allocator->ctx);
+        }
+        ts_buffer_free(&chunks, allocator);
+        ts_buffer_free(&heading_pairs, allocator);
+        ts_buffer_free(&heading_values, allocator);
+        ts_blocks_free(blocks, allocator);
+        result = (TS_Load_Result) {0};
+    }
+    ts_buffer_free(&pairs, allocator);
+    ts_buffer_free(&values, allocator);
+
+    return result;
+}
+
+void ts_unload1(TS_Load_Result result, TS_Allocator *allocator)
+{
+    TS_Allocator heap;
+    if (!allocator)
+    {
+        heap = ts_get_stdlib_allocator();
+        allocator = &heap;
+    }
+
+    ts_blocks_free(result.arena, allocator); // may also hold ts_unescape_pair copies
+    void *tables[] = { result.chunks, result.all_pairs, result.values, result.key_maps, result.nodes, result.node_map,
+                       result.ext_resources, result.sub_resources, result.resource_handles, result.resource_map,
+                       result.connections, result.node_connections, result.names, result.name_map };
+    for (int i = 0; i < (int)(sizeof(tables) / sizeof(tables[0])); i++)
+    {
+        if (tables[i]) allocator->free(tables[i], allocator->ctx);
+    }
+}
+
+/* Loader arena */
+
+#ifndef TS_LOADER_BLOCK_SIZE
+#define TS_LOADER_BLOCK_SIZE (1 << 20)
+#endif
+
+typedef struct TS_Loader_Block TS_Loader_Block;
+struct TS_Loader_Block
+{
+    TS_Loader_Block *next;
+    ptrdiff_t size; // usable bytes after the header
+};
+
+#define TS_LOADER_ALIGN 16
+#define TS_LOADER_HEADER ((ptrdiff_t)((sizeof(TS_Loader_Block) + TS_LOADER_ALIGN - 1) & ~(TS_LOADER_ALIGN - 1)))
+
+static _Bool ts_loader_grow(TS_Loader *loader, ptrdiff_t size)
+{
+    ptrdiff_t block_size = loader->capacity > TS_LOADER_BLOCK_SIZE ? loader->capacity : TS_LOADER_BLOCK_SIZE;
+    block_size = block_size > size ? block_size : size;
+
+    TS_Loader_Block *block = loader->backing.malloc(TS_LOADER_HEADER + block_size, loader->backing.ctx);
+    if (!block)
+    {
+        return 0;
+    }
+    block->next = loader->blocks;
+    block->size = block_size;
+    loader->blocks    = block;
+    loader->beg       = (char *) block + TS_LOADER_HEADER;
+    loader->end       = loader->beg + block_size;
+    loader->capacity += block_size;
+    return 1;
+}
+
+static void *ts_loader_malloc(ptrdiff_t size, void *ctx)
+{
+    TS_Loader *loader = ctx;
+    size = (size + TS_LOADER_ALIGN - 1) & ~(ptrdiff_t)(TS_LOADER_ALIGN - 1);
+    if (loader->end - loader->beg < size && !ts_loader_grow(loader, size))
+    {
+        return 0;
+    }
+
+    void *r = loader->beg;
+    loader->beg  += size;
+    loader->last  = r;
+    loader->used += size;
+    loader->high_water = loader->used > loader->high_water ? loader->used : loader->high_water;
+    return r;
+}
+
+// The newest allocation grows into the rest of its block instead of leaving
+// a copy behind
+static void *ts_loader_resize(void *ptr, ptrdiff_t old_size, ptrdiff_t new_size, void *ctx)
+{
+    (void) old_size;
+    TS_Loader *loader = ctx;
+    new_size = (new_size + TS_LOADER_ALIGN - 1) & ~(ptrdiff_t)(TS_LOADER_ALIGN - 1);
+    if (!ptr || ptr != loader->last || loader->end - (char *) ptr < new_size)
+    {
+        return 0;
+    }
+
+    loader->used += (char *) ptr + new_size - loader->beg;
+    loader->beg   = (char *) ptr + new_size;
+    loader->high_water = loader->used > loader->high_water ? loader->used : loader->high_water;
+    return ptr;
+}
+
+// Only the newest allocation can be taken back, everything else waits for a reset
+static void ts_loader_free_one(void *ptr, void *ctx)
+{
+    TS_Loader *loader = ctx;
+    if (ptr && ptr == loader->last)
+    {
+        loader->used -= loader->beg - (char *) ptr;
+        loader->beg   = ptr;
+        loader->last  = 0;
+    }
+}
+
+void ts_loader_init(TS_Loader *loader, TS_Allocator *backing)
+{
+    *loader = (TS_Loader) {0};
+    loader->backing          = backing ? *backing : ts_get_stdlib_allocator();
+    loader->allocator.malloc = &ts_loader_malloc;
+    loader->allocator.free   = &ts_loader_free_one;
+    loader->allocator.resize = &ts_loader_resize;
+    loader->allocator.ctx    = loader;
+}
+
+TS_Load_Result ts_loader_load(TS_Loader *loader, char *source, ptrdiff_t source_len, TS_Load_Flags flags)
+{
+    return ts_load2(source, source_len, &loader->allocator, flags);
+}
+
+static void ts_loader_release(TS_Loader *loader)
+{
+    for (TS_Loader_Block *block = loader->blocks, *next; block; block = next)
+    {
+        next = block->next;
+        loader->backing.free(block, loader->backing.ctx);
+    }
+    loader->blocks   = 0;
+    loader->beg      = loader->end = 0;
+    loader->capacity = 0;
+}
+
+// A load that spilled into several blocks is folded into one block as big as
+// the high water mark, so the next load of that size allocates nothing
+void ts_loader_reset(TS_Loader *loader)
+{
+    TS_Loader_Block *block = loader->blocks;
+    if (block && block->next)
+    {
+        ts_loader_release(loader);
+        ts_loader_grow(loader, loader->high_water);
+    }
+    else if (block)
+    {
+        loader->beg = (char *) block + TS_LOADER_HEADER;
+    }
+    loader->used = 0;
+    loader->last = 0;
+}
+
+void ts_loader_free(TS_Loader *loader)
+{
+    ts_loader_release(loader);
+    loader->used = loader->high_water = 0;
+    loader->last = 0;
+}
+
+/* Scene diff */
+
+// Replacing a node's type or scene means rebuilding it, so those never match
+static _Bool ts_same_node_kind(TS_Chunk *from, TS_Chunk *to)
+{
+    TS_Str keys[] = { S("type"), S("instance"), S("instance_placeholder") };
+    for (int i = 0; i < (int)(sizeof(keys) / sizeof(keys[0])); i++)
+    {
+        if (!ts_equals(ts_heading_value(from, keys[i]), ts_heading_value(to, keys[i])))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+typedef struct
+{
+    TS_Node *nodes;
+    uint64_t hash;
+    ptrdiff_t parent;
+    TS_Str name;
+    _Bool *taken;
+} TS_Diff_Match;
+
+static _Bool ts_diff_match_node(void *ctx, ptrdiff_t entry)
+{
+    TS_Diff_Match *m = ctx;
+    TS_Node *candidate = &m->nodes[entry - 1];
+    return candidate->path_hash == m->hash && candidate->parent == m->parent &&
+           ts_equals(U(candidate->name.data, candidate->name.len), m->name) && !m->taken[entry - 1];
+}
+
+// The old node at the same path, if its parent is the one `to`'s parent matched
+static ptrdiff_t ts_diff_match(TS_Load_Result *from, TS_Load_Result *to, ptrdiff_t node, ptrdiff_t *match, _Bool *taken)
+{
+    TS_Node *new_node = &to->nodes[node];
+    TS_Str name = U(new_node->name.data, new_node->name.len);
+    ptrdiff_t old = -1;
+
+    if (node == 0)
+    {
+        old = from->nodes_len ? 0 : -1;
+    }
+    else if (new_node->parent >= 0)
+    {
+        ptrdiff_t parent = match[new_node->parent];
+        if (parent < 0)
+        {
+            return -1;
+        }
+
+        TS_Table table = { from->node_map, from->node_map_cap, 0 };
+        TS_Diff_Match same_place = { from->nodes, new_node->path_hash, parent, name, taken };
+        old = ts_table_find(table, new_node->path_hash, ts_diff_match_node, &same_place) - 1;
+    }
+    else
+    {
+        // Nodes under an instanced scene's children are not in the node map, match
+        // them on their parent path text. There are rarely more than a handful.
+        TS_Str parent = ts_heading_value(&to->chunks[new_node->chunk], S("parent"));
+        for (ptrdiff_t i = 1; i < from->nodes_len && old < 0; i++)
+        {
+            TS_Node *candidate = &from->nodes[i];
+            if (candidate->parent < 0 && !taken[i] &&
+                ts_equals(U(candidate->name.data, candidate->name.len), name) &&
+                ts_equals(ts_heading_value(&from->chunks[candidate->chunk], S("parent")), parent))
+            {
+                old = i;
+            }
+        }
+    }
+
+    if (old >= 0 && (taken[old] || !ts_same_node_kind(&from->chunks[from->nodes[old].chunk], &to->chunks[new_node->chunk])))
+    {
+        return -1;
+    }
+    return old;
+}
+
+static _Bool ts_same_pair(TS_Pair *a, TS_Pair *b)
+{
+    return a->flags == b->flags && ts_equals(U(a->value.data, a->value.len), U(b->value.data, b->value.len));
+}
+
+static _Bool ts_diff_push(TS_Buffer *changes, TS_Allocator *allocator, TS_Change change)
+{
+    TS_Change *slot = push(changes, allocator, TS_Change);
+    if (slot)
+    {
+        *slot = change;
+    }
+    return slot != 0;
+}
+
+// Property and child order changes of one matched node, heading pairs first. name and parent
+// can't differ on a match, and the node kind was compared while matching.
+static _Bool ts_diff_node(TS_Buffer *changes, TS_Allocator *allocator, TS_Load_Result *from, TS_Load_Result *to,
+                          ptrdiff_t *match, ptrdiff_t node)
+{
+    ptrdiff_t old = match[node];
+    TS_Chunk *old_chunk = &from->chunks[from->nodes[old].chunk];
+    TS_Chunk *new_chunk = &to->chunks[to->nodes[node].chunk];
+
+    for (int heading = 1; heading >= 0; heading--)
+    {
+        TS_Pair *pairs = heading ? new_chunk->heading_pairs : new_chunk->pairs;
+        ptrdiff_t len  = heading ? new_chunk->heading_pairs_len : new_chunk->pairs_len;
+        for (ptrdiff_t i = 0; i < len; i++)
+        {
+            TS_Str key = U(pairs[i].key.data, pairs[i].key.len);
+            TS_Pair *was = ts_chunk_lookup(old_chunk, (_Bool) heading, key);
+            if (heading && (ts_equals(key, S("name")) || ts_equals(key, S("parent"))))
+            {
+                continue;
+            }
+            if (!was || !ts_same_pair(was, &pairs[i]))
+            {
+                TS_Change change = { TS_Change_Property_Set, old, node, was ? was - from->all_pairs : -1, &pairs[i] - to->all_pairs };
+                if (!ts_diff_push(changes, allocator, change)) return 0;
+            }
+        }
+
+        pairs = heading ? old_chunk->heading_pairs : old_chunk->pairs;
+        len   = heading ? old_chunk->heading_pairs_len : old_chunk->pairs_len;
+        for (ptrdiff_t i = 0; i < len; i++)
+        {
+            if (!ts_chunk_lookup(new_chunk, (_Bool) heading, U(pairs[i].key.data, pairs[i].key.len)))
+            {
+                TS_Change change = { TS_Change_Property_Removed, old, node, &pairs[i] - from->all_pairs, -1 };
+                if (!ts_diff_push(changes, allocator, change)) return 0;
+            }
+        }
+    }
+
+    // Siblings are in file order, so kept children are in their old order
+    // exactly when their old indices still rise. A matched child's old node is
+    // always a child of `old`.
+    ptrdiff_t last = -1;
+    for (ptrdiff_t child = to->nodes[node].first_child; child >= 0; child = to->nodes[child].next_sibling)
+    {
+        ptrdiff_t was = match[child];
+        if (was >= 0 && was < last)
+        {
+            TS_Change change = { TS_Change_Children_Reordered, old, node, -1, -1 };
+            return ts_diff_push(changes, allocator, change);
+        }
+        last = was >= 0 ? was : last;
+    }
+    return 1;
+}
+
+TS_Diff ts_diff(TS_Load_Result *from, TS_Load_Result *to, TS_Allocator *allocator)
+{
+    TS_Allocator heap;
+    if (!allocator)
+    {
+        heap = ts_get_stdlib_allocator();
+        allocator = &heap;
+    }
+
+    TS_Diff diff = {0};
+    TS_Buffer changes = {0};
+    ptrdiff_t *match = to->nodes_len ? allocator->malloc(to->nodes_len * (ptrdiff_t) sizeof(ptrdiff_t), allocator->ctx) : 0;
+    _Bool *taken = from->nodes_len ? allocator->malloc(from->nodes_len, allocator->ctx) : 0;
+    _Bool ok = (match || !to->nodes_len) && (taken || !from->nodes_len);
+    if (taken)
+    {
+        memset(taken, 0, from->nodes_len);
+    }
+
+    // Parents come first in both files, so a parent is matched before its children
+    for (ptrdiff_t i = 0; ok && i < to->nodes_len; i++)
+    {
+        match[i] = ts_diff_match(from, to, i, match, taken);
+        if (match[i] >= 0)
+        {
+            taken[match[i]] = 1;
+        }
+    }
+
+    // Children go before their parents
+    for (ptrdiff_t i = from->nodes_len - 1; ok && i >= 0; i--)
+    {
+        if (!taken[i])
+        {
+            ok = ts_diff_push(&changes, allocator, (TS_Change) { TS_Change_Node_Removed, i, -1, -1, -1 });
+        }
+    }
+
+    for (ptrdiff_t i = 0; ok && i < to->nodes_len; i++)
+    {
+        ok = match[i] < 0
+            ? ts_diff_push(&changes, allocator, (TS_Change) { TS_Change_Node_Added, -1, i, -1, -1 })
+            : ts_diff_node(&changes, allocator, from, to, match, i);
+    }
+
+    if (match) allocator->free(match, allocator->ctx);
+    if (taken) allocator->free(taken, allocator->ctx);
+    if (!ok)
+    {
+        ts_buffer_free(&changes, allocator);
+        return diff;
+    }
+
+    diff.ok          = 1;
+    diff.changes     = (TS_Change *) changes.data;
+    diff.changes_len = changes.len / (ptrdiff_t) sizeof(TS_Change);
+    return diff;
+}
+
+void ts_diff_free(TS_Diff *diff, TS_Allocator *allocator)
+{
+    TS_Allocator heap;
+    if (!allocator)
+    {
+        heap = ts_get_stdlib_allocator();
+        allocator = &heap;
+    }
+
+    if (diff->changes)
+    {
+        allocator->free(diff->changes, allocator->ctx);
+    }
+    *diff = (TS_Diff) {0};
+}
+
+/* Instancing */
+
+// All of a group's arrays live in one allocation, laid out widest first
+static _Bool ts_group_reserve(TS_Entity_Group *group, ptrdiff_t cap, TS_Allocator *allocator)
+{
+    if (cap <= group->cap)
+    {
+        return 1;
+    }
+    ptrdiff_t grown = group->cap ? group->cap : 64;
+    while (grown < cap)
+    {
+        grown *= 2;
+    }
+
+    ptrdiff_t per_entity = 5*sizeof(float) + 3*sizeof(int32_t) + sizeof(_Bool);
+    char *block = allocator->malloc(grown * per_entity, allocator->ctx);
+    if (!block)
+    {
+        return 0;
+    }
+
+    TS_Entity_Group old = *group;
+    char *at = block;
+    group->position_x = (float *) at;   at += grown * sizeof(float);
+    group->position_y = (float *) at;   at += grown * sizeof(float);
+    group->rotation   = (float *) at;   at += grown * sizeof(float);
+    group->scale_x    = (float *) at;   at += grown * sizeof(float);
+    group->scale_y    = (float *) at;   at += grown * sizeof(float);
+    group->entity     = (int32_t *) at; at += grown * sizeof(int32_t);
+    group->parent     = (int32_t *) at; at += grown * sizeof(int32_t);
+    group->texture    = (int32_t *) at; at += grown * sizeof(int32_t);
+    group->visible    = (_Bool *) at;
+    group->cap        = grown;
+
+    if (old.len)
+    {
+        memcpy(group->position_x, old.position_x, old.len * sizeof(float));
+        memcpy(group->position_y, old.position_y, old.len * sizeof(float));
+        memcpy(group->rotation,   old.rotation,   old.len * sizeof(float));
+        memcpy(group->scale_x,    old.scale_x,    old.len * sizeof(float));
+        memcpy(group->scale_y,    old.scale_y,    old.len * sizeof(float));
+        memcpy(group->entity,     old.entity,     old.len * sizeof(int32_t));
+        memcpy(group->parent,     old.parent,     old.len * sizeof(int32_t));
+        memcpy(group->texture,    old.texture,    old.len * sizeof(int32_t));
+        memcpy(group->visible,    old.visible,    old.len * sizeof(_Bool));
+    }
+    if (old.position_x)
+    {
+        allocator->free(old.position_x, allocator->ctx);
+    }
+    return 1;
+}
+
+static TS_Entity_Group *ts_store_group(TS_Entity_Store *store, TS_Str type, TS_Allocator *allocator)
+{
+    // A scene has a handful of types, a linear scan from the newest group is enough
+    for (ptrdiff_t i = store->groups_len - 1; i >= 0; i--)
+    {
+        TS_Entity_Group *group = &store->groups[i];
+        if (ts_equals(U(group->type.data, group->type.len), type))
+        {
+            return group;
+        }
+    }
+
+    if (store->groups_len == store->groups_cap)
+    {
+        ptrdiff_t cap = store->groups_cap ? store->groups_cap * 2 : 8;
+        TS_Entity_Group *groups = allocator->malloc(cap * (ptrdiff_t) sizeof(TS_Entity_Group), allocator->ctx);
+        if (!groups)
+        {
+            return 0;
+        }
+        if (store->groups_len)
+        {
+            memcpy(groups, store->groups, store->groups_len * sizeof(TS_Entity_Group));
+        }
+        if (store->groups)
+        {
+            allocator->free(store->groups, allocator->ctx);
+        }
+        store->groups     = groups;
+        store->groups_cap = cap;
+    }
+
+    TS_Entity_Group *group = &store->groups[store->groups_len++];
+    *group = (TS_Entity_Group) {0};
+    group->type.data = type.data;
+    group->type.len  = type.len;
+    return group;
+}
+
+static TS_Variant ts_pair_variant(TS_Load_Result *scene, TS_Pair *pair)
+{
+    if (scene->values)
+    {
+        return scene->values[pair - scene->all_pairs];
+    }
+
+    // Only flat values are wanted here, so parse without handing out item slots
+    TS_Variant variant = {0};
+    TS_Variant_Parser parser = {0};
+    parser.at  = pair->value.data;
+    parser.end = pair->value.data + pair->value.len;
+    ts_parse_variant(&parser, &variant);
+    if (parser.error || variant.type == TS_Variant_Array || variant.type == TS_Variant_Dictionary)
+    {
+        variant = (TS_Variant) {0};
+    }
+    return variant;
+}
+
+static double ts_variant_number(TS_Variant variant, double fallback)
+{
+    return variant.type == TS_Variant_Float ? variant.real
+         : variant.type == TS_Variant_Int   ? (double) variant.integer
+         : fallback;
+}
+
+TS_Entity_Store ts_entity_template(TS_Load_Result *scene, TS_Allocator *allocator)
+{
+    TS_Allocator heap;
+    if (!allocator)
+    {
+        heap = ts_get_stdlib_allocator();
+        allocator = &heap;
+    }
+
+    TS_Entity_Store store = {0};
+    store.entities_len = scene->nodes_len;
+
+    for (ptrdiff_t n = 0; n < scene->nodes_len; n++)
+    {
+        TS_Node *node   = &scene->nodes[n];
+        TS_Chunk *chunk = &scene->chunks[node->chunk];
+
+        TS_Entity_Group *group = ts_store_group(&store, ts_heading_value(chunk, S("type")), allocator);
+        if (!group || !ts_group_reserve(group, group->len + 1, allocator))
+        {
+            ts_entity_store_free(&store, allocator);
+            return store;
+        }
+
+        ptrdiff_t e = group->len++;
+        group->entity[e]     = (int32_t) n;
+        group->parent[e]     = (int32_t) node->parent;
+        group->position_x[e] = 0;
+        group->position_y[e] = 0;
+        group->rotation[e]   = 0;
+        group->scale_x[e]    = 1;
+        group->scale_y[e]    = 1;
+        group->texture[e]    = -1;
+        group->visible[e]    = 1;
+
+        TS_Pair *texture = ts_chunk_lookup(chunk, 0, S("texture"));
+        if (texture)
+        {
+            TS_Resource_Handle handle = scene->resource_handles[texture - scene->all_pairs];
+            group->texture[e] = handle.heading == TS_Heading_Ext_Resource ? handle.index : -1;
+        }
+
+        TS_Pair *pair = ts_chunk_lookup(chunk, 0, S("position"));
+        TS_Variant value = pair ? ts_pair_variant(scene, pair) : (TS_Variant) {0};
+        if (value.type == TS_Variant_Vector2)
+        {
+            group->position_x[e] = value.f[0];
+            group->position_y[e] = value.f[1];
+        }
+
+        pair  = ts_chunk_lookup(chunk, 0, S("scale"));
+        value = pair ? ts_pair_variant(scene, pair) : (TS_Variant) {0};
+        if (value.type == TS_Variant_Vector2)
+        {
+            group->scale_x[e] = value.f[0];
+            group->scale_y[e] = value.f[1];
+        }
+
+        pair = ts_chunk_lookup(chunk, 0, S("rotation"));
+        if (pair)
+        {
+            group->rotation[e] = (float) ts_variant_number(ts_pair_variant(scene, pair), 0);
+        }
+
+        pair  = ts_chunk_lookup(chunk, 0, S("visible"));
+        value = pair ? ts_pair_variant(scene, pair) : (TS_Variant) {0};
+        if (value.type == TS_Variant_Bool)
+        {
+            group->visible[e] = value.boolean;
+        }
+    }
+
+    store.ok = 1;
+    return store;
+}
+
+// Each copy is a memcpy per property plus an offset added to the ids. Every
+// group is reserved before anything is copied, so a failure leaves `store` as it was.
+ptrdiff_t ts_instantiate(TS_Entity_Store *store, TS_Entity_Store *scene_template, ptrdiff_t count, TS_Allocator *allocator)
+{
+    TS_Allocator heap;
+    if (!allocator)
+    {
+        heap = ts_get_stdlib_allocator();
+        allocator = &heap;
+    }
+
+    // A store copying into itself would have its groups moved under the copy
+    ptrdiff_t first = store->entities_len;
+    ptrdiff_t stride = scene_template->entities_len;
+    if (count < 0 || store == scene_template || (stride && count > (INT32_MAX - first) / stride))
+    {
+        return -1;
+    }
+
+    for (ptrdiff_t g = 0; g < scene_template->groups_len; g++)
+    {
+        TS_Entity_Group *from = &scene_template->groups[g];
+        TS_Entity_Group *to   = ts_store_group(store, U(from->type.data, from->type.len), allocator);
+        if (!to || !ts_group_reserve(to, to->len + count * from->len, allocator))
+        {
+            return -1;
+        }
+    }
+
+    for (ptrdiff_t g = 0; g < scene_template->groups_len; g++)
+    {
+        TS_Entity_Group *from = &scene_template->groups[g];
+        TS_Entity_Group *to   = ts_store_group(store, U(from->type.data, from->type.len), allocator); // found, nothing allocated
+        for (ptrdiff_t copy = 0; copy < count; copy++)
+        {
+            ptrdiff_t at = to->len;
+            ptrdiff_t n  = from->len;
+            memcpy(to->position_x + at, from->position_x, n * sizeof(float));
+            memcpy(to->position_y + at, from->position_y, n * sizeof(float));
+            memcpy(to->rotation   + at, from->rotation,   n * sizeof(float));
+            memcpy(to->scale_x    + at, from->scale_x,    n * sizeof(float));
+            memcpy(to->scale_y    + at, from->scale_y,    n * sizeof(float));
+            memcpy(to->texture    + at, from->texture,    n * sizeof(int32_t));
+            memcpy(to->visible    + at, from->visible,    n * sizeof(_Bool));
+
+            int32_t base = (int32_t)(first + copy * stride);
+            for (ptrdiff_t i = 0; i < n; i++)
+            {
+                int32_t parent = from->parent[i];
+                to->entity[at + i] = from->entity[i] + base;
+                to->parent[at + i] = parent < 0 ? parent : parent + base;
+            }
+            to->len += n;
+        }
+    }
+
+    store->entities_len += count * stride;
+    store->ok = 1;
+    return first;
+}
+
+void ts_entity_store_free(TS_Entity_Store *store, TS_Allocator *allocator)
+{
+    TS_Allocator heap;
+    if (!allocator)
+    {
+        heap = ts_get_stdlib_allocator();
+        allocator = &heap;
+    }
+
+    for (ptrdiff_t g = 0; g < store->groups_len; g++)
+    {
+        if (store->groups[g].position_x)
+        {
+            allocator->free(store->groups[g].position_x, allocator->ctx);
+        }
+    }
+    if (store->groups)
+    {
+        allocator->free(store->groups, allocator->ctx);
+    }
+    *store = (TS_Entity_Store) {0};
+}
+
+/* Tile maps */
+
+static int32_t ts_tile_chunk_coord(int32_t v)
+{
+    return v >= 0 ? v / TS_TILE_CHUNK_SIZE : -((-(v + 1)) / TS_TILE_CHUNK_SIZE) - 1;
+}
+
+static uint64_t ts_tile_chunk_hash(int32_t x, int32_t y)
+{
+    uint64_t key = (uint64_t)(uint32_t) x << 32 | (uint32_t) y;
+    return (key * 0x9e3779b97f4a7c15ull) >> 17;
+}
+
+typedef struct
+{
+    TS_Tile_Chunk *chunks;
+    int32_t x;
+    int32_t y;
+} TS_Tile_Chunk_Match;
+
+static _Bool ts_tile_chunk_match(void *ctx, ptrdiff_t entry)
+{
+    TS_Tile_Chunk_Match *m = ctx;
+    return m->chunks[entry - 1].x == m->x && m->chunks[entry - 1].y == m->y;
+}
+
+ptrdiff_t ts_tile_chunk_find(TS_Tile_Grid *grid, int32_t chunk_x, int32_t chunk_y)
+{
+    TS_Table table = { grid->chunk_map, grid->chunk_map_cap, 0 };
+    TS_Tile_Chunk_Match match = { grid->chunks, chunk_x, chunk_y };
+    return ts_table_find(table, ts_tile_chunk_hash(chunk_x, chunk_y), ts_tile_chunk_match, &match) - 1;
+}
+
+static void ts_tile_map_insert(TS_Tile_Grid *grid, ptrdiff_t chunk)
+{
+    TS_Table table = { grid->chunk_map, grid->chunk_map_cap, 0 };
+    ts_table_insert(table, ts_tile_chunk_hash(grid->chunks[chunk].x, grid->chunks[chunk].y), chunk + 1);
+}
+
+static ptrdiff_t ts_tile_chunk_add(TS_Tile_Grid *grid, int32_t chunk_x, int32_t chunk_y, TS_Allocator *allocator)
+{
+    if (grid->chunks_len == grid->chunks_cap)
+    {
+        ptrdiff_t cap = grid->chunks_cap ? grid->chunks_cap * 2 : 16;
+        TS_Tile_Chunk *chunks = allocator->malloc(cap * (ptrdiff_t) sizeof(TS_Tile_Chunk), allocator->ctx);
+        if (!chunks)
+        {
+            return -1;
+        }
+        if (grid->chunks_len)
+        {
+            memcpy(chunks, grid->chunks, grid->chunks_len * sizeof(TS_Tile_Chunk));
+        }
+        if (grid->chunks)
+        {
+            allocator->free(grid->chunks, allocator->ctx);
+        }
+        grid->chunks     = chunks;
+        grid->chunks_cap = cap;
+    }
+
+    // Kept at most half full, rebuilt from the chunk array when it grows
+    if ((grid->chunks_len + 1) * 2 > grid->chunk_map_cap)
+    {
+        ptrdiff_t cap = grid->chunk_map_cap ? grid->chunk_map_cap * 2 : 32;
+        ptrdiff_t *map = allocator->malloc(cap * (ptrdiff_t) sizeof(ptrdiff_t), allocator->ctx);
+        if (!map)
+        {
+            return -1;
+        }
+        memset(map, 0, cap * sizeof(ptrdiff_t));
+        if (grid->chunk_map)
+        {
+            allocator->free(grid->chunk_map, allocator->ctx);
+        }
+        grid->chunk_map     = map;
+        grid->chunk_map_cap = cap;
+        for (ptrdiff_t i = 0; i < grid->chunks_len; i++)
+        {
+            ts_tile_map_insert(grid, i);
+        }
+    }
+
+    ptrdiff_t index = grid->chunks_len++;
+    TS_Tile_Chunk *chunk = &grid->chunks[index];
+    memset(chunk, 0, sizeof(*chunk));
+    memset(chunk->tiles, 0xff, sizeof(chunk->tiles)); // every field TS_TILE_EMPTY
+    chunk->x = chunk_x;
+    chunk->y = chunk_y;
+    ts_tile_map_insert(grid, index);
+    return index;
+}
+
+TS_Tile ts_tile_get(TS_Tile_Grid *grid, int32_t x, int32_t y)
+{
+    TS_Tile empty = { TS_TILE_EMPTY, TS_TILE_EMPTY, TS_TILE_EMPTY, TS_TILE_EMPTY };
+    int32_t chunk_x = ts_tile_chunk_coord(x);
+    int32_t chunk_y = ts_tile_chunk_coord(y);
+    ptrdiff_t chunk = ts_tile_chunk_find(grid, chunk_x, chunk_y);
+    if (chunk < 0)
+    {
+        return empty;
+    }
+    int32_t local_x = x - chunk_x * TS_TILE_CHUNK_SIZE;
+    int32_t local_y = y - chunk_y * TS_TILE_CHUNK_SIZE;
+    return grid->chunks[chunk].tiles[local_y * TS_TILE_CHUNK_SIZE + local_x];
+}
+
+_Bool ts_tile_set(TS_Tile_Grid *grid, int32_t x, int32_t y, TS_Tile tile, TS_Allocator *allocator)
+{
+    TS_Allocator heap;
+    if (!allocator)
+    {
+        heap = ts_get_stdlib_allocator();
+        allocator = &heap;
+    }
+
+    int32_t chunk_x = ts_tile_chunk_coord(x);
+    int32_t chunk_y = ts_tile_chunk_coord(y);
+    ptrdiff_t chunk = ts_tile_chunk_find(grid, chunk_x, chunk_y);
+    if (chunk < 0)
+    {
+        if (tile.source == TS_TILE_EMPTY)
+        {
+            return 1;
+        }
+        chunk = ts_tile_chunk_add(grid, chunk_x, chunk_y, allocator);
+        if (chunk < 0)
+        {
+            return 0;
+        }
+    }
+
+    TS_Tile_Chunk *c = &grid->chunks[chunk];
+    TS_Tile *slot = &c->tiles[(y - chunk_y * TS_TILE_CHUNK_SIZE) * TS_TILE_CHUNK_SIZE + (x - chunk_x * TS_TILE_CHUNK_SIZE)];
+    c->count += (tile.source != TS_TILE_EMPTY) - (slot->source != TS_TILE_EMPTY);
+    *slot = tile;
+    c->dirty = 1;
+    return 1;
+}
+
+ptrdiff_t ts_tile_rect(TS_Tile_Grid *grid, int32_t x, int32_t y, int32_t width, int32_t height, TS_Tile *out)
+{
+    TS_Tile empty = { TS_TILE_EMPTY, TS_TILE_EMPTY, TS_TILE_EMPTY, TS_TILE_EMPTY };
+    for (ptrdiff_t i = 0; i < (ptrdiff_t) width * height; i++)
+    {
+        out[i] = empty;
+    }
+
+    // Whole rows are copied out of each chunk the rectangle overlaps
+    ptrdiff_t found = 0;
+    int32_t last_x = x + width - 1;
+    int32_t last_y = y + height - 1;
+    for (int32_t chunk_y = ts_tile_chunk_coord(y); width > 0 && chunk_y <= ts_tile_chunk_coord(last_y); chunk_y++)
+    {
+        for (int32_t chunk_x = ts_tile_chunk_coord(x); chunk_x <= ts_tile_chunk_coord(last_x); chunk_x++)
+        {
+            ptrdiff_t chunk = ts_tile_chunk_find(grid, chunk_x, chunk_y);
+            if (chunk < 0 || !grid->chunks[chunk].count)
+            {
+                continue;
+            }
+
+            TS_Tile_Chunk *c = &grid->chunks[chunk];
+            int32_t base_x = chunk_x * TS_TILE_CHUNK_SIZE;
+            int32_t base_y = chunk_y * TS_TILE_CHUNK_SIZE;
+            int32_t from_x = x > base_x ? x : base_x;
+            int32_t to_x   = last_x < base_x + TS_TILE_CHUNK_SIZE - 1 ? last_x : base_x + TS_TILE_CHUNK_SIZE - 1;
+            int32_t from_y = y > base_y ? y : base_y;
+            int32_t to_y   = last_y < base_y + TS_TILE_CHUNK_SIZE - 1 ? last_y : base_y + TS_TILE_CHUNK_SIZE - 1;
+            for (int32_t ty = from_y; ty <= to_y; ty++)
+            {
+                TS_Tile *row = &c->tiles[(ty - base_y) * TS_TILE_CHUNK_SIZE + (from_x - base_x)];
+                TS_Tile *dst = &out[(ptrdiff_t)(ty - y) * width + (from_x - x)];
+                memcpy(dst, row, (to_x - from_x + 1) * sizeof(TS_Tile));
+                for (int32_t tx = 0; tx <= to_x - from_x; tx++)
+                {
+                    found += row[tx].source != TS_TILE_EMPTY;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+// TileMap's layer_N/tile_data holds three ints per cell: x and y as int16 halves,
+// then source | atlas x << 16, then atlas y | alternative << 16. TileMapLayer's
+// tile_map_data is a byte array, a uint16 version then six uint16 per cell.
+_Bool ts_tile_grid_import(TS_Tile_Grid *grid, char *value, ptrdiff_t value_len, TS_Allocator *allocator)
+{
+    TS_Allocator heap;
+    if (!allocator)
+    {
+        heap = ts_get_stdlib_allocator();
+        allocator = &heap;
+    }
+
+    TS_Packed_Info info = ts_packed_info(value, value_len);
+    _Bool bytes = info.type == TS_Packed_Byte;
+    if (!info.ok || (info.type != TS_Packed_Int32 && !bytes) || (bytes && info.len && (info.len < 2 || (info.len - 2) % 12)))
+    {
+        return 0;
+    }
+
+    void *cells = allocator->malloc(info.size ? info.size : 1, allocator->ctx);
+    if (!cells)
+    {
+        return 0;
+    }
+
+    _Bool ok = ts_decode_packed(value, value_len, cells, info.size);
+    ptrdiff_t cells_len = bytes ? (info.len ? (info.len - 2) / 12 : 0) : info.len / 3;
+    for (ptrdiff_t i = 0; ok && i < cells_len; i++)
+    {
+        int32_t x, y;
+        TS_Tile tile;
+        if (bytes)
+        {
+            unsigned char *cell = (unsigned char *) cells + 2 + i * 12;
+            uint16_t fields[6];
+            for (int f = 0; f < 6; f++)
+            {
+                fields[f] = (uint16_t)(cell[2*f] | cell[2*f + 1] << 8);
+            }
+            x = (int16_t) fields[0];
+            y = (int16_t) fields[1];
+            tile.source      = fields[2];
+            tile.atlas_x     = fields[3];
+            tile.atlas_y     = fields[4];
+            tile.alternative = fields[5];
+        }
+        else
+        {
+            uint32_t *cell = (uint32_t *) cells + i * 3;
+            x = (int16_t)(cell[0] & 0xffff);
+            y = (int16_t)(cell[0] >> 16);
+            tile.source      = (uint16_t)(cell[1] & 0xffff);
+            tile.atlas_x     = (uint16_t)(cell[1] >> 16);
+            tile.atlas_y     = (uint16_t)(cell[2] & 0xffff);
+            tile.alternative = (uint16_t)(cell[2] >> 16);
+        }
+        ok = ts_tile_set(grid, x, y, tile, allocator);
+    }
+
+    allocator->free(cells, allocator->ctx);
+    return ok;
+}
+
+TS_Tile_Grid ts_tile_grid_from_node(TS_Load_Result *scene, ptrdiff_t node, int layer, TS_Allocator *allocator)
+{
+    TS_Tile_Grid grid = {0};
+    if (node < 0 || node >= scene->nodes_len)
+    {
+        return grid;
+    }
+
+    TS_Chunk *chunk = &scene->chunks[scene->nodes[node].chunk];
+    char digits[16];
+    int digits_len = 0;
+    for (unsigned n = layer < 0 ? 0 : (unsigned) layer; !digits_len || n; n /= 10)
+    {
+        digits[digits_len++] = (char)('0' + n % 10);
+    }
+    char key[32] = "layer_";
+    int key_len = 6;
+    while (digits_len)
+    {
+        key[key_len++] = digits[--digits_len];
+    }
+    memcpy(key + key_len, "/tile_data", 10);
+    key_len += 10;
+    TS_Pair *pair = ts_chunk_get(chunk, key, key_len);
+    if (!pair && layer == 0)
+    {
+        pair = ts_chunk_get(chunk, "tile_map_data", 13);
+    }
+    if (!pair)
+    {
+        return grid;
+    }
+
+    grid.ok = ts_tile_grid_import(&grid, pair->value.data, pair->value.len, allocator);
+    if (!grid.ok)
+    {
+        ts_tile_grid_free(&grid, allocator);
+    }
+    return grid;
+}
+
+void ts_tile_grid_free(TS_Tile_Grid *grid, TS_Allocator *allocator)
+{
+    TS_Allocator heap;
+    if (!allocator)
+    {
+        heap = ts_get_stdlib_allocator();
+        allocator = &heap;
+    }
+
+    if (grid->chunks)
+    {
+        allocator->free(grid->chunks, allocator->ctx);
+    }
+    if (grid->chunk_map)
+    {
+        allocator->free(grid->chunk_map, allocator->ctx);
+    }
+    *grid = (TS_Tile_Grid) {0};
+}
+
+/* Saving */
+
+// Measures while `data` is null, so the same calls size the output exactly and then fill it
+typedef struct
+{
+    char *data;
+    ptrdiff_t len;
+} TS_Writer;
+
+static void ts_write(TS_Writer *w, TS_Str s)
+{
+    if (w->data && s.len)
+    {
+        memcpy(w->data + w->len, s.data, s.len);
+    }
+    w->len += s.len;
+}
+
+// Edited values are written from their unescaped form. Most contain nothing to
+// escape and go out as a single copy, the rest are split around the few
+// characters that need it.
+static void ts_write_escaped(TS_Writer *w, TS_Str s)
+{
+    char *beg = s.data;
+    char *end = s.data + s.len;
+    for (char *at = beg; at < end; at++)
+    {
+        char c = *at;
+        if (c == '"' || c == '\\')
+        {
+            ts_write(w, span(beg, at));
+            ts_write(w, c == '"' ? S("\\\"") : S("\\\\"));
+            beg = at + 1;
+        }
+    }
+    ts_write(w, span(beg, end));
+}
+
+static void ts_write_value(TS_Writer *w, TS_Pair *pair)
+{
+    // Values that were not edited go back exactly as they were read
+    _Bool verbatim = pair->raw.data && !(pair->flags & TS_Pair_Dirty);
+    TS_Str value = verbatim ? U(pair->raw.data, pair->raw.len) : U(pair->value.data, pair->value.len);
+    if (pair->flags & TS_Pair_Quoted)
+    {
+        ts_write(w, S("\""));
+        if (verbatim || (pair->flags & TS_Pair_Escaped))
+        {
+            ts_write(w, value);
+        }
+        else
+        {
+            ts_write_escaped(w, value);
+        }
+        ts_write(w, S("\""));
+    }
+    else
+    {
+        ts_write(w, value);
+    }
+}
+
+// Godot writes runs of [ext_resource], [connection] and [editable] one line
+// after another, every other chunk follows a blank line
+static _Bool ts_chunk_continues_run(TS_Chunk *previous, TS_Chunk *chunk)
+{
+    if (previous->heading != chunk->heading)
+    {
+        return 0;
+    }
+
+    switch (chunk->heading)
+    {
+    case TS_Heading_Ext_Resource:
+    case TS_Heading_Connection:
+        return 1;
+    case TS_Heading_Nothing:
+        return ts_equals(S("editable"), U(chunk->source.data, chunk->source.len)) &&
+               ts_equals(S("editable"), U(previous->source.data, previous->source.len));
+    default:
+        return 0;
+    }
+}
+
+// Godot's layout, for chunks that have no source text to follow
+static void ts_write_chunk(TS_Writer *w, TS_Chunk *chunk)
+{
+    ts_write(w, S("["));
+    ts_write(w, U(chunk->source.data, chunk->source.len));
+    for (ptrdiff_t p = 0; p < chunk->heading_pairs_len; p++)
+    {
+        TS_Pair *pair = &chunk->heading_pairs[p];
+        ts_write(w, S(" "));
+        ts_write(w, U(pair->key.data, pair->key.len));
+        ts_write(w, S("="));
+        ts_write_value(w, pair);
+    }
+    ts_write(w, S("]\n"));
+
+    for (ptrdiff_t p = 0; p < chunk->pairs_len; p++)
+    {
+        TS_Pair *pair = &chunk->pairs[p];
+        ts_write(w, U(pair->key.data, pair->key.len));
+        ts_write(w, S(" = "));
+        ts_write_value(w, pair);
+        ts_write(w, S("\n"));
+    }
+}
+
+static TS_Pair *ts_chunk_pair_at(TS_Chunk *chunk, ptrdiff_t i)
+{
+    return i < chunk->heading_pairs_len ? &chunk->heading_pairs[i] : &chunk->pairs[i - chunk->heading_pairs_len];
+}
+
+// Every pair still has its span in the chunk's text, in source order
+static _Bool ts_chunk_follows_text(TS_Chunk *chunk)
+{
+    if (!chunk->text.data)
+    {
+        return 0;
+    }
+
+    char *at  = chunk->text.data;
+    char *end = chunk->text.data + chunk->text.len;
+    for (ptrdiff_t i = 0; i < chunk->heading_pairs_len + chunk->pairs_len; i++)
+    {
+        TS_Pair *pair = ts_chunk_pair_at(chunk, i);
+        if (!pair->span.data || pair->span.data < at || pair->span.len > end - pair->span.data)
+        {
+            return 0;
+        }
+        at = pair->span.data + pair->span.len;
+    }
+    return 1;
+}
+
+// Copies the text between values as one piece. A value is written apart when
+// it was edited, or when a writable load unescaped it over its source and
+// moved `raw` out.
+static void ts_write_chunk_text(TS_Writer *w, TS_Chunk *chunk)
+{
+    char *at  = chunk->text.data;
+    char *end = chunk->text.data + chunk->text.len;
+    for (ptrdiff_t i = 0; i < chunk->heading_pairs_len + chunk->pairs_len; i++)
+    {
+        TS_Pair *pair = ts_chunk_pair_at(chunk, i);
+        _Bool moved = (uintptr_t) pair->raw.data - (uintptr_t) pair->span.data > (uintptr_t) pair->span.len;
+        if ((pair->flags & TS_Pair_Dirty) || moved)
+        {
+            ts_write(w, span(at, pair->span.data));
+            ts_write_value(w, pair);
+            at = pair->span.data + pair->span.len;
+        }
+    }
+    ts_write(w, span(at, end));
+}
+
+static void ts_write_chunks(TS_Writer *w, TS_Chunk *chunks, ptrdiff_t chunks_len)
+{
+    // A chunk's text brings its own blank lines, only generated chunks need them
+    _Bool previous_text = 0;
+    for (ptrdiff_t i = 0; i < chunks_len; i++)
+    {
+        TS_Chunk *chunk = &chunks[i];
+        if (ts_chunk_follows_text(chunk))
+        {
+            ts_write_chunk_text(w, chunk);
+            previous_text = 1;
+            continue;
+        }
+
+        _Bool blank_line = i && !ts_chunk_continues_run(&chunks[i - 1], chunk);
+        if (previous_text)
+        {
+            TS_Str text = U(chunks[i - 1].text.data, chunks[i - 1].text.len);
+            _Bool line_ended = text.len && text.data[text.len - 1] == '\n';
+            if (!line_ended)
+            {
+                ts_write(w, S("\n"));
+            }
+            blank_line &= !(line_ended && text.len > 1 && text.data[text.len - 2] == '\n');
+        }
+        if (blank_line)
+        {
+            ts_write(w, S("\n"));
+        }
+        ts_write_chunk(w, chunk);
+        previous_text = 0;
+    }
+}
+
+void ts_set_value(TS_Pair *pair, char *value, ptrdiff_t value_len, _Bool quoted)
+{
+    pair->value.data = value;
+    pair->value.len  = value_len;
+    pair->flags      = TS_Pair_Dirty | (quoted ? TS_Pair_Quoted : 0);
+}
+
+// Touches no shared state, so saving from a background thread is fine as long
+// as the chunks are left alone until it returns.
+TS_Save_Result ts_save1(TS_Chunk *chunks, ptrdiff_t chunks_len, TS_Allocator *allocator)
+{
+    TS_Allocator heap;
+    if (!allocator)
+    {
+        heap = ts_get_stdlib_allocator();
+        allocator = &heap;
+    }
+
+    TS_Save_Result result = {0};
+
+    TS_Writer measure = {0};
+    ts_write_chunks(&measure, chunks, chunks_len);
+
+    TS_Writer writer = {0};
+    writer.data = allocator->malloc(measure.len ? measure.len : 1, allocator->ctx);
+    if (!writer.data)
+    {
+        return result;
+    }
+    ts_write_chunks(&writer, chunks, chunks_len);
+    ts_assert(writer.len == measure.len);
+
+    result.ok         = 1;
+    result.output     = writer.data;
+    result.output_len = writer.len;
+    return result;
+}
+
+#ifndef TEXT_SCENE_IGNORE_STDLIB
+// Writes the scene to `savepath`, the output buffer is freed once written
+TS_Save_Result ts_save(TS_Chunk *chunks, ptrdiff_t chunks_len, char *savepath)
+{
+    TS_Allocator allocator = ts_get_stdlib_allocator();
+    TS_Save_Result result = ts_save1(chunks, chunks_len, &allocator);
+    if (!result.ok)
+    {
+        return result;
+    }
+
+    FILE *file = fopen(savepath, "wb");
+    result.ok = file && fwrite(result.output, 1, result.output_len, file) == (size_t) result.output_len;
+    if (file)
+    {
+        result.ok = !fclose(file) && result.ok;
+    }
+
+    free(result.output);
+    result.output = 0;
+    return result;
+}
+#endif
+
+/* Scene cache */
+
+#ifndef TEXT_SCENE_IGNORE_STDLIB
+
+#define TS_CACHE_VERSION 7
+
+// Bumped whenever a cooked struct changes size
+#define TS_CACHE_LAYOUT ((uint32_t)(sizeof(TS_Chunk) | sizeof(TS_Pair) << 8 | sizeof(TS_Variant) << 16 | sizeof(TS_Node) << 24))
+
+// Every pointer in a cooked blob holds an offset from the start of the blob,
+// 0 for null, so it can be mapped anywhere. Sections follow the header in this order.
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t layout;
+    uint32_t pointer_size;
+    uint32_t flags;
+    uint64_t source_hash;
+    int64_t source_len;
+    int64_t blob_len;
+    int64_t strings_len; // the source plus raw values moved out of it
+
+    int64_t chunks_len;
+    int64_t all_pairs_len;
+    int64_t key_maps_len;
+    int64_t items_len;
+    int64_t nodes_len;
+    int64_t node_map_cap;
+    int64_t ext_resources_len;
+    int64_t sub_resources_len;
+    int64_t resource_map_cap;
+    int64_t connections_len;
+    int64_t names_len;
+    int64_t name_map_cap;
+
+    int64_t strings;
+    int64_t chunks;
+    int64_t pairs;
+    int64_t values;
+    int64_t items;
+    int64_t key_maps;
+    int64_t nodes;
+    int64_t node_map;
+    int64_t ext_resources;
+    int64_t sub_resources;
+    int64_t resource_handles;
+    int64_t resource_map;
+    int64_t connections;
+    int64_t node_connections;
+    int64_t names;
+    int64_t name_map;
+} TS_Cache_Header;
+
+// Hashes 8 bytes per step, the key only has to tell edited files apart
+uint64_t ts_source_hash(char *source, ptrdiff_t source_len)
+{
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ (uint64_t) source_len;
+    ptrdiff_t i = 0;
+    for (; i + 8 <= source_len; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, source + i, 8);
+        h ^= word * 0xff51afd7ed558ccdull;
+        h = (h << 31 | h >> 33) * 0xc4ceb9fe1a85ec53ull;
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, source + i, source_len - i);
+    h ^= tail * 0xff51afd7ed558ccdull;
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+static void ts_cache_put(void *field, ptrdiff_t offset)
+{
+    uintptr_t value = (uintptr_t) offset;
+    memcpy(field, &value, sizeof(value));
+}
+
+// Where one section sits in the blob, every offset into it is checked against this
+typedef struct
+{
+    int64_t begin;
+    int64_t end;
+    int64_t size; // of one record
+} TS_Cache_Span;
+
+// A section has to sit after the header, aligned and inside the blob. Offset 0
+// is a null array, allowed for an optional one or when it is empty.
+static _Bool ts_cache_span(TS_Cache_Span *span, int64_t offset, int64_t len, int64_t size, _Bool optional, int64_t blob_len)
+{
+    span->begin = offset;
+    span->end   = offset;
+    span->size  = size;
+    if (!offset)
+    {
+        return optional || !len;
+    }
+    if (len < 0 || offset < (int64_t) sizeof(TS_Cache_Header) || offset % 8 || offset > blob_len || len > (blob_len - offset) / size)
+    {
+        return 0;
+    }
+    span->end = offset + len * size;
+    return 1;
+}
+
+// Turns the offset in `field` back into a pointer. Fails, leaving null, unless
+// it starts a record in `span` with `count` records left, or is 0 with no records.
+static _Bool ts_cache_get(void *field, char *blob, TS_Cache_Span span, ptrdiff_t count)
+{
+    uintptr_t value;
+    memcpy(&value, field, sizeof(value));
+    char *pointer = 0;
+    _Bool ok = value ? count >= 0 && value >= (uintptr_t) span.begin && value <= (uintptr_t) span.end &&
+                       (value - span.begin) % span.size == 0 && count <= (int64_t)(span.end - value) / span.size
+                     : !count;
+    if (ok && value)
+    {
+        pointer = blob + value;
+    }
+    memcpy(field, &pointer, sizeof(pointer));
+    return ok;
+}
+
+static char *ts_cache_at(char *blob, TS_Cache_Span span)
+{
+    return span.begin ? blob + span.begin : 0;
+}
+
+typedef struct
+{
+    char *blob;
+    char *source;
+    ptrdiff_t source_len;
+    int64_t strings;
+    int64_t strings_used; // copies appended after the source
+    int64_t items;
+    int64_t items_used;
+} TS_Cooker;
+
+static _Bool ts_in_source(char *source, ptrdiff_t source_len, char *data)
+{
+    return (uintptr_t) data - (uintptr_t) source <= (uintptr_t) source_len;
+}
+
+static ptrdiff_t ts_cook_string(TS_Cooker *cooker, char *data)
+{
+    return data ? cooker->strings + (data - cooker->source) : 0;
+}
+
+// Raw values a writable load moved out of the source are copied in after it
+static ptrdiff_t ts_cook_raw(TS_Cooker *cooker, char *data, ptrdiff_t len)
+{
+    if (!data || ts_in_source(cooker->source, cooker->source_len, data))
+    {
+        return ts_cook_string(cooker, data);
+    }
+
+    int64_t offset = cooker->strings + cooker->source_len + cooker->strings_used;
+    memcpy(cooker->blob + offset, data, len);
+    cooker->strings_used += len;
+    return offset;
+}
+
+static int64_t ts_variant_items_total(TS_Variant *variants, ptrdiff_t len)
+{
+    int64_t total = 0;
+    for (ptrdiff_t i = 0; i < len; i++)
+    {
+        TS_Variant *v = &variants[i];
+        if (v->type == TS_Variant_Array || v->type == TS_Variant_Dictionary)
+        {
+            ptrdiff_t items = v->array.len * (v->type == TS_Variant_Dictionary ? 2 : 1);
+            total += items + ts_variant_items_total(v->array.items, items);
+        }
+    }
+    return total;
+}
+
+// Copies `len` variants to `offset`, nested items are laid out after them depth first
+static void ts_cook_variants(TS_Cooker *cooker, int64_t offset, TS_Variant *variants, ptrdiff_t len)
+{
+    TS_Variant *out = (TS_Variant *)(cooker->blob + offset);
+    memcpy(out, variants, len * sizeof(TS_Variant));
+
+    for (ptrdiff_t i = 0; i < len; i++)
+    {
+        TS_Variant *v = &out[i];
+        switch (v->type)
+        {
+        case TS_Variant_Raw:
+        case TS_Variant_String:
+        case TS_Variant_String_Name:
+        case TS_Variant_Node_Path:
+        case TS_Variant_Ext_Resource:
+        case TS_Variant_Sub_Resource:
+            ts_cache_put(&v->string.data, ts_cook_string(cooker, v->string.data));
+            break;
+
+        case TS_Variant_Constructor:
+            ts_cache_put(&v->constructor.name.data, ts_cook_string(cooker, v->constructor.name.data));
+            ts_cache_put(&v->constructor.args.data, ts_cook_string(cooker, v->constructor.args.data));
+            break;
+
+        case TS_Variant_Array:
+        case TS_Variant_Dictionary:
+        {
+            ptrdiff_t items = v->array.len * (v->type == TS_Variant_Dictionary ? 2 : 1);
+            int64_t items_offset = items ? cooker->items + cooker->items_used * (int64_t) sizeof(TS_Variant) : 0;
+            cooker->items_used += items;
+            ts_cook_variants(cooker, items_offset, variants[i].array.items, items);
+            ts_cache_put(&v->array.items, items_offset);
+        } break;
+
+        default:
+            break;
+        }
+    }
+}
+
+static int64_t ts_cache_section(int64_t *at, int64_t size)
+{
+    int64_t offset = size ? *at : 0;
+    *at += (size + 7) & ~(int64_t) 7;
+    return offset;
+}
+
+// Serializes a loaded scene whose slices all point into `source`, apart from
+// the raw values of escaped pairs
+static TS_Save_Result ts_cook(TS_Load_Result *result, char *source, ptrdiff_t source_len, TS_Load_Flags flags, TS_Allocator *allocator)
+{
+    TS_Save_Result saved = {0};
+
+    TS_Cache_Header header = {0};
+    memcpy(header.magic, "TSCACHE", 8);
+    header.version           = TS_CACHE_VERSION;
+    header.layout            = TS_CACHE_LAYOUT;
+    header.pointer_size      = sizeof(void *);
+    header.flags             = flags & TS_Load_Decode_Values;
+    header.source_len        = source_len;
+    header.chunks_len        = result->chunks_len;
+    header.all_pairs_len     = result->all_pairs_len;
+    header.key_maps_len      = result->key_maps_len;
+    header.items_len         = result->values ? ts_variant_items_total(result->values, result->all_pairs_len) : 0;
+    header.nodes_len         = result->nodes_len;
+    header.node_map_cap      = result->node_map_cap;
+    header.ext_resources_len = result->ext_resources_len;
+    header.sub_resources_len = result->sub_resources_len;
+    header.resource_map_cap  = result->resource_map_cap;
+    header.connections_len   = result->connections_len;
+    header.names_len         = result->names_len;
+    header.name_map_cap      = result->name_map_cap;
+
+    ptrdiff_t moved_len = 0;
+    for (ptrdiff_t i = 0; i < result->all_pairs_len; i++)
+    {
+        TS_Pair *pair = &result->all_pairs[i];
+        moved_len += pair->raw.data && !ts_in_source(source, source_len, pair->raw.data) ? pair->raw.len : 0;
+    }
+
+    int64_t at = sizeof(TS_Cache_Header);
+    header.strings_len      = source_len + moved_len;
+    header.strings          = ts_cache_section(&at, header.strings_len);
+    header.chunks           = ts_cache_section(&at, header.chunks_len * sizeof(TS_Chunk));
+    header.pairs            = ts_cache_section(&at, header.all_pairs_len * sizeof(TS_Pair));
+    header.values           = ts_cache_section(&at, result->values ? header.all_pairs_len * sizeof(TS_Variant) : 0);
+    header.items            = ts_cache_section(&at, header.items_len * sizeof(TS_Variant));
+    header.key_maps         = ts_cache_section(&at, header.key_maps_len * sizeof(int32_t));
+    header.nodes            = ts_cache_section(&at, header.nodes_len * sizeof(TS_Node));
+    header.node_map         = ts_cache_section(&at, header.node_map_cap * sizeof(ptrdiff_t));
+    header.ext_resources    = ts_cache_section(&at, header.ext_resources_len * sizeof(TS_Resource));
+    header.sub_resources    = ts_cache_section(&at, header.sub_resources_len * sizeof(TS_Resource));
+    header.resource_handles = ts_cache_section(&at, result->resource_handles ? header.all_pairs_len * sizeof(TS_Resource_Handle) : 0);
+    header.resource_map     = ts_cache_section(&at, header.resource_map_cap * sizeof(ptrdiff_t));
+    header.connections      = ts_cache_section(&at, header.connections_len * sizeof(TS_Connection));
+    header.node_connections = ts_cache_section(&at, result->node_connections ? (header.nodes_len + 1) * sizeof(ptrdiff_t) : 0);
+    header.names            = ts_cache_section(&at, header.names_len * sizeof(TS_Name));
+    header.name_map         = ts_cache_section(&at, header.name_map_cap * sizeof(ptrdiff_t));
+    header.blob_len         = at;
+
+    char *blob = allocator->malloc(at, allocator->ctx);
+    if (!blob)
+    {
+        return saved;
+    }
+    memset(blob, 0, at);
+    memcpy(blob, &header, sizeof(header));
+
+    TS_Cooker cooker = {0};
+    cooker.blob    = blob;
+    cooker.source     = source;
+    cooker.source_len = source_len;
+    cooker.strings    = header.strings;
+    cooker.items   = header.items;
+
+    if (source_len)
+    {
+        memcpy(blob + header.strings, source, source_len);
+    }
+
+    TS_Chunk *chunks = (TS_Chunk *)(blob + header.chunks);
+    for (ptrdiff_t i = 0; i < result->chunks_len; i++)
+    {
+        TS_Chunk *chunk = &result->chunks[i];
+        chunks[i] = *chunk;
+        ts_cache_put(&chunks[i].source.data, ts_cook_string(&cooker, chunk->source.data));
+        ts_cache_put(&chunks[i].text.data, ts_cook_string(&cooker, chunk->text.data));
+        ts_cache_put(&chunks[i].heading_pairs, chunk->heading_pairs ? header.pairs + (chunk->heading_pairs - result->all_pairs) * (int64_t) sizeof(TS_Pair) : 0);
+        ts_cache_put(&chunks[i].pairs, chunk->pairs ? header.pairs + (chunk->pairs - result->all_pairs) * (int64_t) sizeof(TS_Pair) : 0);
+        ts_cache_put(&chunks[i].key_map, chunk->key_map ? header.key_maps + (chunk->key_map - result->key_maps) * (int64_t) sizeof(int32_t) : 0);
+    }
+
+    TS_Pair *pairs = (TS_Pair *)(blob + header.pairs);
+    for (ptrdiff_t i = 0; i < result->all_pairs_len; i++)
+    {
+        pairs[i] = result->all_pairs[i];
+        ts_cache_put(&pairs[i].key.data, ts_cook_string(&cooker, pairs[i].key.data));
+        ts_cache_put(&pairs[i].value.data, ts_cook_string(&cooker, pairs[i].value.data));
+        ts_cache_put(&pairs[i].raw.data, ts_cook_raw(&cooker, pairs[i].raw.data, pairs[i].raw.len));
+        ts_cache_put(&pairs[i].span.data, ts_cook_string(&cooker, pairs[i].span.data));
+    }
+
+    if (result->values)
+    {
+        ts_cook_variants(&cooker, header.values, result->values, result->all_pairs_len);
+    }
+
+    TS_Node *nodes = (TS_Node *)(blob + header.nodes);
+    for (ptrdiff_t i = 0; i < result->nodes_len; i++)
+    {
+        nodes[i] = result->nodes[i];
+        ts_cache_put(&nodes[i].name.data, ts_cook_string(&cooker, nodes[i].name.data));
+    }
+
+    TS_Resource *resources[2] = { (TS_Resource *)(blob + header.ext_resources), (TS_Resource *)(blob + header.sub_resources) };
+    TS_Resource *loaded[2]    = { result->ext_resources, result->sub_resources };
+    ptrdiff_t resources_len[2] = { result->ext_resources_len, result->sub_resources_len };
+    for (int kind = 0; kind < 2; kind++)
+    {
+        for (ptrdiff_t i = 0; i < resources_len[kind]; i++)
+        {
+            resources[kind][i] = loaded[kind][i];
+            ts_cache_put(&resources[kind][i].id.data, ts_cook_string(&cooker, loaded[kind][i].id.data));
+        }
+    }
+
+    if (header.key_maps)
+    {
+        memcpy(blob + header.key_maps, result->key_maps, header.key_maps_len * sizeof(int32_t));
+    }
+    if (header.node_map)
+    {
+        memcpy(blob + header.node_map, result->node_map, header.node_map_cap * sizeof(ptrdiff_t));
+    }
+    if (header.resource_handles)
+    {
+        memcpy(blob + header.resource_handles, result->resource_handles, header.all_pairs_len * sizeof(TS_Resource_Handle));
+    }
+    if (header.resource_map)
+    {
+        memcpy(blob + header.resource_map, result->resource_map, header.resource_map_cap * sizeof(ptrdiff_t));
+    }
+    if (header.connections)
+    {
+        memcpy(blob + header.connections, result->connections, header.connections_len * sizeof(TS_Connection));
+    }
+    if (header.node_connections)
+    {
+        memcpy(blob + header.node_connections, result->node_connections, (header.nodes_len + 1) * sizeof(ptrdiff_t));
+    }
+    if (header.name_map)
+    {
+        memcpy(blob + header.name_map, result->name_map, header.name_map_cap * sizeof(ptrdiff_t));
+    }
+
+    TS_Name *names = (TS_Name *)(blob + header.names);
+    for (ptrdiff_t i = 0; i < result->names_len; i++)
+    {
+        names[i] = result->names[i];
+        ts_cache_put(&names[i].data, ts_cook_string(&cooker, names[i].data));
+    }
+
+    saved.ok         = 1;
+    saved.output     = blob;
+    saved.output_len = at;
+    return saved;
+}
+
+// Turns the offsets in a private mapping back into pointers. This is one
+// linear pass over the fixed size records, nothing is parsed. Every section and
+// every offset is bounds checked first, a cache file that fails comes back not ok.
+static TS_Load_Result ts_cache_relocate(char *blob, ptrdiff_t blob_len)
+{
+    TS_Load_Result result = {0};
+    TS_Cache_Header *header = (TS_Cache_Header *) blob;
+
+    TS_Cache_Span strings, chunks, pairs, values, items, key_maps, nodes, node_map, ext_resources, sub_resources,
+                  resource_handles, resource_map, connections, node_connections, names, name_map;
+    _Bool ok = header->strings_len >= header->source_len && header->nodes_len >= 0 && header->nodes_len < PTRDIFF_MAX;
+    ok = ok && ts_cache_span(&strings,          header->strings,          header->strings_len,       1,                          0, blob_len);
+    ok = ok && ts_cache_span(&chunks,           header->chunks,           header->chunks_len,        sizeof(TS_Chunk),           0, blob_len);
+    ok = ok && ts_cache_span(&pairs,            header->pairs,            header->all_pairs_len,     sizeof(TS_Pair),            0, blob_len);
+    ok = ok && ts_cache_span(&values,           header->values,           header->all_pairs_len,     sizeof(TS_Variant),         1, blob_len);
+    ok = ok && ts_cache_span(&items,            header->items,            header->items_len,         sizeof(TS_Variant),         0, blob_len);
+    ok = ok && ts_cache_span(&key_maps,         header->key_maps,         header->key_maps_len,      sizeof(int32_t),            0, blob_len);
+    ok = ok && ts_cache_span(&nodes,            header->nodes,            header->nodes_len,         sizeof(TS_Node),            0, blob_len);
+    ok = ok && ts_cache_span(&node_map,         header->node_map,         header->node_map_cap,      sizeof(ptrdiff_t),          0, blob_len);
+    ok = ok && ts_cache_span(&ext_resources,    header->ext_resources,    header->ext_resources_len, sizeof(TS_Resource),        0, blob_len);
+    ok = ok && ts_cache_span(&sub_resources,    header->sub_resources,    header->sub_resources_len, sizeof(TS_Resource),        0, blob_len);
+    ok = ok && ts_cache_span(&resource_handles, header->resource_handles, header->all_pairs_len,     sizeof(TS_Resource_Handle), 1, blob_len);
+    ok = ok && ts_cache_span(&resource_map,     header->resource_map,     header->resource_map_cap,  sizeof(ptrdiff_t),          0, blob_len);
+    ok = ok && ts_cache_span(&connections,      header->connections,      header->connections_len,   sizeof(TS_Connection),      0, blob_len);
+    ok = ok && ts_cache_span(&node_connections, header->node_connections, header->nodes_len + 1,     sizeof(ptrdiff_t),          1, blob_len);
+    ok = ok && ts_cache_span(&names,            header->names,            header->names_len,         sizeof(TS_Name),            0, blob_len);
+    ok = ok && ts_cache_span(&name_map,         header->name_map,         header->name_map_cap,      sizeof(ptrdiff_t),          0, blob_len);
+    if (!ok)
+    {
+        return result;
+    }
+
+    result.chunks            = (TS_Chunk *) ts_cache_at(blob, chunks);
+    result.chunks_len        = header->chunks_len;
+    result.all_pairs         = (TS_Pair *) ts_cache_at(blob, pairs);
+    result.all_pairs_len     = header->all_pairs_len;
+    result.values            = (TS_Variant *) ts_cache_at(blob, values);
+    result.key_maps          = (int32_t *) ts_cache_at(blob, key_maps);
+    result.key_maps_len      = header->key_maps_len;
+    result.nodes             = (TS_Node *) ts_cache_at(blob, nodes);
+    result.nodes_len         = header->nodes_len;
+    result.node_map          = (ptrdiff_t *) ts_cache_at(blob, node_map);
+    result.node_map_cap      = header->node_map_cap;
+    result.ext_resources     = (TS_Resource *) ts_cache_at(blob, ext_resources);
+    result.ext_resources_len = header->ext_resources_len;
+    result.sub_resources     = (TS_Resource *) ts_cache_at(blob, sub_resources);
+    result.sub_resources_len = header->sub_resources_len;
+    result.resource_handles  = (TS_Resource_Handle *) ts_cache_at(blob, resource_handles);
+    result.resource_map      = (ptrdiff_t *) ts_cache_at(blob, resource_map);
+    result.resource_map_cap  = header->resource_map_cap;
+    result.connections       = (TS_Connection *) ts_cache_at(blob, connections);
+    result.connections_len   = header->connections_len;
+    result.node_connections  = (ptrdiff_t *) ts_cache_at(blob, node_connections);
+    result.names             = (TS_Name *) ts_cache_at(blob, names);
+    result.names_len         = header->names_len;
+    result.name_map          = (ptrdiff_t *) ts_cache_at(blob, name_map);
+    result.name_map_cap      = header->name_map_cap;
+    result.mapping           = blob;
+    result.mapping_len       = blob_len;
+
+    for (ptrdiff_t i = 0; ok && i < result.chunks_len; i++)
+    {
+        TS_Chunk *chunk = &result.chunks[i];
+        ok &= ts_cache_get(&chunk->source.data, blob, strings, chunk->source.len);
+        ok &= ts_cache_get(&chunk->text.data, blob, strings, chunk->text.len);
+        ok &= ts_cache_get(&chunk->heading_pairs, blob, pairs, chunk->heading_pairs_len);
+        ok &= ts_cache_get(&chunk->pairs, blob, pairs, chunk->pairs_len);
+        ok &= ts_cache_get(&chunk->key_map, blob, key_maps, chunk->key_map_cap);
+    }
+
+    for (ptrdiff_t i = 0; ok && i < result.all_pairs_len; i++)
+    {
+        TS_Pair *pair = &result.all_pairs[i];
+        ok &= ts_cache_get(&pair->key.data, blob, strings, pair->key.len);
+        ok &= ts_cache_get(&pair->value.data, blob, strings, pair->value.len);
+        ok &= ts_cache_get(&pair->raw.data, blob, strings, pair->raw.len);
+        ok &= ts_cache_get(&pair->span.data, blob, strings, pair->span.len);
+    }
+
+    // Values and nested items sit back to back, so both relocate in one sweep
+    ptrdiff_t variants_len = result.values ? result.all_pairs_len + header->items_len : 0;
+    for (ptrdiff_t i = 0; ok && i < variants_len; i++)
+    {
+        TS_Variant *v = i < result.all_pairs_len
+            ? &result.values[i]
+            : (TS_Variant *)(blob + items.begin) + (i - result.all_pairs_len);
+        switch (v->type)
+        {
+        case TS_Variant_Raw:
+        case TS_Variant_String:
+        case TS_Variant_String_Name:
+        case TS_Variant_Node_Path:
+        case TS_Variant_Ext_Resource:
+        case TS_Variant_Sub_Resource:
+            ok &= ts_cache_get(&v->string.data, blob, strings, v->string.len);
+            break;
+
+        case TS_Variant_Constructor:
+            ok &= ts_cache_get(&v->constructor.name.data, blob, strings, v->constructor.name.len);
+            ok &= ts_cache_get(&v->constructor.args.data, blob, strings, v->constructor.args.len);
+            break;
+
+        case TS_Variant_Array:
+        case TS_Variant_Dictionary:
+        {
+            // Items are cooked depth first, so they always come after their parent, which rules out cycles
+            _Bool fits = v->array.len >= 0 && v->array.len <= header->items_len;
+            ptrdiff_t count = fits ? v->array.len * (v->type == TS_Variant_Dictionary ? 2 : 1) : -1;
+            ok &= ts_cache_get(&v->array.items, blob, items, count);
+            ok &= !v->array.items || v->array.items > v;
+        } break;
+
+        default:
+            break;
+        }
+    }
+
+    for (ptrdiff_t i = 0; ok && i < result.nodes_len; i++)
+    {
+        ok &= ts_cache_get(&result.nodes[i].name.data, blob, strings, result.nodes[i].name.len);
+    }
+    for (ptrdiff_t i = 0; ok && i < result.ext_resources_len; i++)
+    {
+        ok &= ts_cache_get(&result.ext_resources[i].id.data, blob, strings, result.ext_resources[i].id.len);
+    }
+    for (ptrdiff_t i = 0; ok && i < result.sub_resources_len; i++)
+    {
+        ok &= ts_cache_get(&result.sub_resources[i].id.data, blob, strings, result.sub_resources[i].id.len);
+    }
+    for (ptrdiff_t i = 0; ok && i < result.names_len; i++)
+    {
+        ok &= ts_cache_get(&result.names[i].data, blob, strings, result.names[i].len);
+    }
+
+    result.ok = ok;
+    return result;
+}
+
+#ifdef _WIN32
+#ifndef _WINDOWS_
+// Declared by hand, windows.h collides with raylib's names
+__declspec(dllimport) void *__stdcall CreateFileA(const char *, unsigned long, unsigned long, void *, unsigned long, unsigned long, void *);
+__declspec(dllimport) int   __stdcall GetFileSizeEx(void *, long long *);
+__declspec(dllimport) void *__stdcall CreateFileMappingA(void *, void *, unsigned long, unsigned long, unsigned long, const char *);
+__declspec(dllimport) void *__stdcall MapViewOfFile(void *, unsigned long, unsigned long, unsigned long, size_t);
+__declspec(dllimport) int   __stdcall UnmapViewOfFile(const void *);
+__declspec(dllimport) int   __stdcall CloseHandle(void *);
+__declspec(dllimport) int   __stdcall CreateDirectoryA(const char *, void *);
+#endif
+
+// Copy on write lets the cache relocate in place without touching the file
+static char *ts_map_file(char *path, ptrdiff_t *len, _Bool copy_on_write)
+{
+    void *file = CreateFileA(path, 0x80000000 /* GENERIC_READ */, 1 /* FILE_SHARE_READ */, 0,
+                             3 /* OPEN_EXISTING */, 0x80 /* FILE_ATTRIBUTE_NORMAL */, 0);
+    if (file == (void *) -1)
+    {
+        return 0;
+    }
+
+    char *map = 0;
+    long long size = 0;
+    if (GetFileSizeEx(file, &size) && size > 0)
+    {
+        void *mapping = CreateFileMappingA(file, 0, copy_on_write ? 0x08 /* PAGE_WRITECOPY */ : 0x02 /* PAGE_READONLY */, 0, 0, 0);
+        if (mapping)
+        {
+            map = MapViewOfFile(mapping, copy_on_write ? 0x01 /* FILE_MAP_COPY */ : 0x04 /* FILE_MAP_READ */, 0, 0, 0);
+            CloseHandle(mapping);
+        }
+        *len = (ptrdiff_t) size;
+    }
+    CloseHandle(file);
+    return map;
+}
+
+static void ts_unmap_file(char *map, ptrdiff_t len)
+{
+    (void) len;
+    UnmapViewOfFile(map);
+}
+
+static void ts_make_directory(char *path)
+{
+    CreateDirectoryA(path, 0);
+}
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Copy on write lets the cache relocate in place without touching the file
+static char *ts_map_file(char *path, ptrdiff_t *len, _Bool copy_on_write)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return 0;
+    }
+
+    char *map = 0;
+    struct stat st;
+    if (!fstat(fd, &st) && st.st_size > 0)
+    {
+        void *mapped = mmap(0, st.st_size, copy_on_write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+        map  = mapped == MAP_FAILED ? 0 : mapped;
+        *len = st.st_size;
+    }
+    close(fd);
+    return map;
+}
+
+static void ts_unmap_file(char *map, ptrdiff_t len)
+{
+    munmap(map, len);
+}
+
+static void ts_make_directory(char *path)
+{
+    mkdir(path, 0777);
+}
+#endif
+
+static _Bool ts_cache_valid(char *blob, ptrdiff_t blob_len, uint64_t hash, ptrdiff_t source_len, TS_Load_Flags flags)
+{
+    TS_Cache_Header *header = (TS_Cache_Header *) blob;
+    return blob_len >= (ptrdiff_t) sizeof(TS_Cache_Header) &&
+           !memcmp(header->magic, "TSCACHE", 8) &&
+           header->version == TS_CACHE_VERSION &&
+           header->layout == TS_CACHE_LAYOUT &&
+           header->pointer_size == sizeof(void *) &&
+           header->flags == (uint32_t)(flags & TS_Load_Decode_Values) &&
+           header->source_hash == hash &&
+           header->source_len == source_len &&
+           header->blob_len == blob_len;
+}
+
+TS_Load_Result ts_load_cached(char *source, ptrdiff_t source_len, char *cache_dir, TS_Load_Flags flags)
+{
+    uint64_t hash = ts_source_hash(source, source_len);
+
+    char path[4096];
+    int path_len = snprintf(path, sizeof(path), "%s/%016llx-%u.tsc", cache_dir, (unsigned long long) hash, (unsigned) flags);
+    if (path_len > 0 && path_len < (int) sizeof(path) - 4)
+    {
+        ptrdiff_t blob_len = 0;
+        char *blob = ts_map_file(path, &blob_len, 1);
+        if (blob && ts_cache_valid(blob, blob_len, hash, source_len, flags))
+        {
+            // A damaged file counts as a miss and gets cooked again below
+            TS_Load_Result cached = ts_cache_relocate(blob, blob_len);
+            if (cached.ok)
+            {
+                return cached;
+            }
+        }
+        if (blob)
+        {
+            ts_unmap_file(blob, blob_len);
+        }
+    }
+
+    TS_Load_Result result = ts_load2(source, source_len, 0, flags);
+    if (!result.ok || path_len <= 0 || path_len >= (int) sizeof(path) - 4)
+    {
+        return result;
+    }
+
+    TS_Allocator allocator = ts_get_stdlib_allocator();
+    TS_Save_Result cooked = ts_cook(&result, source, source_len, flags, &allocator);
+    if (cooked.ok)
+    {
+        ((TS_Cache_Header *) cooked.output)->source_hash = hash;
+
+        // Write beside the final name and rename, so a reader never maps half a file
+        ts_make_directory(cache_dir);
+        char temporary[4096];
+        memcpy(temporary, path, path_len);
+        memcpy(temporary + path_len, ".tmp", 5);
+
+        FILE *file = fopen(temporary, "wb");
+        _Bool written = file && fwrite(cooked.output, 1, cooked.output_len, file) == (size_t) cooked.output_len;
+        if (file)
+        {
+            written = !fclose(file) && written;
+        }
+        if (written && rename(temporary, path))
+        {
+            remove(path); // Windows won't rename over an existing file
+            written = !rename(temporary, path);
+        }
+        if (!written)
+        {
+            remove(temporary);
+        }
+        free(cooked.output);
+    }
+    return result;
+}
+
+// The mapping stays open for the result's slices until ts_unload
+TS_Load_Result ts_load_file(char *path, TS_Load_Flags flags)
+{
+    ptrdiff_t source_len = 0;
+    char *source = ts_map_file(path, &source_len, 0);
+    if (!source)
+    {
+        return (TS_Load_Result) {0};
+    }
+
+    TS_Load_Result result = ts_load2(source, source_len, 0, flags | TS_Load_Read_Only);
+    if (!result.ok)
+    {
+        ts_unmap_file(source, source_len);
+        return result;
+    }
+    result.source_mapping     = source;
+    result.source_mapping_len = source_len;
+    return result;
+}
+
+// Releases a result from ts_load, ts_load1 without an allocator, ts_load2,
+// ts_load_cached or ts_load_file
+void ts_unload(TS_Load_Result result)
+{
+    if (result.mapping)
+    {
+        TS_Allocator allocator = ts_get_stdlib_allocator();
+        ts_blocks_free(result.arena, &allocator); // may also hold ts_unescape_pair copies
+        ts_unmap_file(result.mapping, result.mapping_len);
+        return;
+    }
+
+    ts_unload1(result, 0);
+    if (result.source_mapping)
+    {
+        ts_unmap_file(result.source_mapping, result.source_mapping_len);
+    }
+}
+
+#endif // TEXT_SCENE_IGNORE_STDLIB
+
+/* Streaming */
+
+static void ts_stream_line(TS_Stream *stream, TS_Str line)
+{
+    TS_Stream_Callbacks *callbacks = &stream->callbacks;
+    if (!line.len)
+    {
+        return;
+    }
+
+    char first = line.data[0];
+    if (first == '[')
+    {
+        stream->in_chunk = 1;
+        if (callbacks->heading)
+        {
+            callbacks->heading(ts_heading_from_line(line).chunk, callbacks->ctx);
+        }
+
+        TS_State heading_state = {0};
+        heading_state.current = line;
+        TS_Pair_Result current_pair;
+        while ((current_pair = ts_next_heading_pair(&heading_state)).ok)
+        {
+            if (callbacks->heading_pair)
+            {
+                callbacks->heading_pair(current_pair.pair, callbacks->ctx);
+            }
+            if (!heading_state.in_bracket)
+            {
+                break;
+            }
+        }
+    }
+    else if (stream->in_chunk && first != ' ' && first != '\r' && first != '\t' && callbacks->pair)
+    {
+        callbacks->pair(ts_pair_from_line(line, 0).pair, callbacks->ctx);
+    }
+}
+
+TS_Stream ts_stream_begin(TS_Stream_Callbacks callbacks, TS_Allocator *allocator)
+{
+    TS_Stream stream = {0};
+    stream.ok        = 1;
+    stream.callbacks = callbacks;
+    stream.allocator = allocator ? *allocator : ts_get_stdlib_allocator();
+    return stream;
+}
+
+_Bool ts_stream_feed(TS_Stream *stream, char *data, ptrdiff_t len)
+{
+    while (len > 0 && stream->ok)
+    {
+        ptrdiff_t line_len = ts_scan_line(&stream->scan, data, len);
+
+        // Whole lines are handed out straight from `data`, only a line cut by the
+        // end of `data` is copied into the pending buffer
+        if (line_len >= 0 && !stream->line.len)
+        {
+            ts_stream_line(stream, U(data, line_len - 1));
+        }
+        else
+        {
+            ptrdiff_t take = line_len >= 0 ? line_len : len;
+            TS_Buffer pending = { stream->line.data, stream->line.len, stream->line.cap };
+            stream->ok = ts_buffer_append(&pending, &stream->allocator, data, take);
+            stream->line.data = pending.data;
+            stream->line.len  = pending.len;
+            stream->line.cap  = pending.cap;
+
+            if (stream->ok && line_len >= 0)
+            {
+                ts_stream_line(stream, U(stream->line.data, stream->line.len - 1));
+                stream->line.len = 0;
+            }
+        }
+
+        ptrdiff_t taken = line_len >= 0 ? line_len : len;
+        data += taken;
+        len  -= taken;
+    }
+    return stream->ok;
+}
+
+_Bool ts_stream_end(TS_Stream *stream)
+{
+    // The last line may have no newline
+    if (stream->ok && stream->line.len)
+    {
+        ts_stream_line(stream, U(stream->line.data, stream->line.len));
+    }
+
+    if (stream->line.data)
+    {
+        stream->allocator.free(stream->line.data, stream->allocator.ctx);
+    }
+    stream->line.data = 0;
+    stream->line.len  = stream->line.cap = 0;
+    return stream->ok;
+}
+
+#ifndef TEXT_SCENE_IGNORE_STDLIB
+
+#ifdef _WIN32
+#include <io.h>
+#define ts_read _read
+#else
+#include <unistd.h>
+#define ts_read read
+#endif
+
+_Bool ts_stream_fd(int fd, TS_Stream_Callbacks callbacks, TS_Allocator *allocator)
+{
+    TS_Stream stream = ts_stream_begin(callbacks, allocator);
+
+    char *buffer = stream.allocator.malloc(TS_STREAM_READ_SIZE, stream.allocator.ctx);
+    _Bool ok = buffer != 0;
+    while (ok)
+    {
+        int len = (int) ts_read(fd, buffer, TS_STREAM_READ_SIZE);
+        if (len <= 0)
+        {
+            ok = len == 0;
+            break;
+        }
+        ok = ts_stream_feed(&stream, buffer, len);
+    }
+
+    if (buffer)
+    {
+        stream.allocator.free(buffer, stream.allocator.ctx);
+    }
+    return ts_stream_end(&stream) && ok;
+}
+
+#undef ts_read
+
+#endif // TEXT_SCENE_IGNORE_STDLIB
+
+/* Async loading */
+
+#ifndef TEXT_SCENE_IGNORE_STDLIB
+
+#if defined(_MSC_VER) && !defined(__clang__) && defined(_M_X64)
+// Aligned x64 loads and stores already have acquire and release order
+static int64_t ts_atomic_load(volatile int64_t *p)            { int64_t v = *p; _ReadWriteBarrier(); return v; }
+static void    ts_atomic_store(volatile int64_t *p, int64_t v) { _ReadWriteBarrier(); *p = v; }
+static _Bool   ts_atomic_cas(volatile int64_t *p, int64_t expected, int64_t desired)
+{
+    return _InterlockedCompareExchange64(p, desired, expected) == expected;
+}
+#elif defined(_MSC_VER) && !defined(__clang__)
+// 32 bit targets would tear a plain 64 bit access
+static int64_t ts_atomic_load(volatile int64_t *p)            { return _InterlockedCompareExchange64(p, 0, 0); }
+static void    ts_atomic_store(volatile int64_t *p, int64_t v)
+{
+    for (int64_t seen = *p; _InterlockedCompareExchange64(p, v, seen) != seen; seen = *p) {}
+}
+static _Bool   ts_atomic_cas(volatile int64_t *p, int64_t expected, int64_t desired)
+{
+    return _InterlockedCompareExchange64(p, desired, expected) == expected;
+}
+#else
+static int64_t ts_atomic_load(volatile int64_t *p)            { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static void    ts_atomic_store(volatile int64_t *p, int64_t v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+static _Bool   ts_atomic_cas(volatile int64_t *p, int64_t expected, int64_t desired)
+{
+    return __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+#endif
+
+#ifdef _WIN32
+#ifndef _WINDOWS_
+__declspec(dllimport) void *__stdcall CreateThread(void *, size_t, unsigned long (__stdcall *)(void *), void *, unsigned long, unsigned long *);
+__declspec(dllimport) unsigned long __stdcall WaitForSingleObject(void *, unsigned long);
+__declspec(dllimport) void *__stdcall CreateSemaphoreA(void *, long, long, const char *);
+__declspec(dllimport) int   __stdcall ReleaseSemaphore(void *, long, long *);
+__declspec(dllimport) int   __stdcall SwitchToThread(void);
+#endif
+
+typedef void *TS_Thread;
+typedef void *TS_Semaphore;
+
+static _Bool ts_semaphore_init(TS_Semaphore *s) { *s = CreateSemaphoreA(0, 0, 0x7fffffff, 0); return *s != 0; }
+static void  ts_semaphore_wait(TS_Semaphore *s) { WaitForSingleObject(*s, 0xffffffff /* INFINITE */); }
+static void  ts_semaphore_post(TS_Semaphore *s) { ReleaseSemaphore(*s, 1, 0); }
+static void  ts_semaphore_free(TS_Semaphore *s) { CloseHandle(*s); }
+static void  ts_yield(void)                     { SwitchToThread(); }
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+
+typedef pthread_t TS_Thread;
+typedef sem_t TS_Semaphore;
+
+static _Bool ts_semaphore_init(TS_Semaphore *s) { return !sem_init(s, 0, 0); }
+static void  ts_semaphore_wait(TS_Semaphore *s) { while (sem_wait(s)) {} } // retried on EINTR
+static void  ts_semaphore_post(TS_Semaphore *s) { sem_post(s); }
+static void  ts_semaphore_free(TS_Semaphore *s) { sem_destroy(s); }
+static void  ts_yield(void)                     { sched_yield(); }
+#endif
+
+// Bounded multi producer, multi consumer ring. A cell's sequence says whose
+// turn it is, so producers and consumers only contend on their own index.
+typedef struct
+{
+    volatile int64_t sequence;
+    int64_t value;
+} TS_Queue_Cell;
+
+typedef struct
+{
+    TS_Queue_Cell *cells;
+    int64_t mask;
+    volatile int64_t enqueue;
+    char pad[64];
+    volatile int64_t dequeue;
+} TS_Queue;
+
+static _Bool ts_queue_init(TS_Queue *q, int64_t cap)
+{
+    q->cells = calloc(cap, sizeof(TS_Queue_Cell));
+    if (!q->cells)
+    {
+        return 0;
+    }
+    for (int64_t i = 0; i < cap; i++)
+    {
+        q->cells[i].sequence = i;
+    }
+    q->mask = cap - 1;
+    return 1;
+}
+
+static _Bool ts_queue_push(TS_Queue *q, int64_t value)
+{
+    int64_t at = ts_atomic_load(&q->enqueue);
+    for (;;)
+    {
+        TS_Queue_Cell *cell = &q->cells[at & q->mask];
+        int64_t turn = ts_atomic_load(&cell->sequence) - at;
+        if (turn == 0 && ts_atomic_cas(&q->enqueue, at, at + 1))
+        {
+            cell->value = value;
+            ts_atomic_store(&cell->sequence, at + 1);
+            return 1;
+        }
+        if (turn < 0)
+        {
+            return 0; // full
+        }
+        at = ts_atomic_load(&q->enqueue);
+    }
+}
+
+static _Bool ts_queue_pop(TS_Queue *q, int64_t *value)
+{
+    int64_t at = ts_atomic_load(&q->dequeue);
+    for (;;)
+    {
+        TS_Queue_Cell *cell = &q->cells[at & q->mask];
+        int64_t turn = ts_atomic_load(&cell->sequence) - (at + 1);
+        if (turn == 0 && ts_atomic_cas(&q->dequeue, at, at + 1))
+        {
+            *value = cell->value;
+            ts_atomic_store(&cell->sequence, at + q->mask + 1);
+            return 1;
+        }
+        if (turn < 0)
+        {
+            return 0; // empty, or the next producer has not finished writing
+        }
+        at = ts_atomic_load(&q->dequeue);
+    }
+}
+
+// Claimed by whoever swaps `key` from 0, `published` says the path is readable
+typedef struct
+{
+    volatile int64_t key;
+    volatile int64_t published;
+    uint64_t mark; // ts_async_ready's visit stamp, main thread only
+} TS_Asset_Slot;
+
+struct TS_Async_Loader
+{
+    char root[TS_ASYNC_PATH_MAX];
+    TS_Asset *assets;
+    TS_Asset_Slot *slots;
+    int64_t slots_mask;
+
+    TS_Queue jobs;     // asset indices waiting for a worker
+    TS_Queue finished; // asset indices waiting for ts_async_poll
+    TS_Semaphore wake; // posted once per job, and once per worker to stop
+    volatile int64_t stop;
+
+    TS_Thread threads[TS_ASYNC_MAX_THREADS];
+    int threads_len;
+    uint64_t ready_mark;
+};
+
+static _Bool ts_async_resolve(TS_Async_Loader *loader, char *path, char *out)
+{
+    ptrdiff_t len = strlen(path);
+    ptrdiff_t root_len = strlen(loader->root);
+    if (len >= 6 && !memcmp(path, "res://", 6))
+    {
+        if (root_len + 1 + len - 6 >= TS_ASYNC_PATH_MAX)
+        {
+            return 0;
+        }
+        memcpy(out, loader->root, root_len);
+        out[root_len] = '/';
+        memcpy(out + root_len + 1, path + 6, len - 6 + 1);
+        return 1;
+    }
+
+    if (len >= TS_ASYNC_PATH_MAX)
+    {
+        return 0;
+    }
+    memcpy(out, path, len + 1);
+    return 1;
+}
+
+static _Bool ts_is_scene_path(char *path)
+{
+    ptrdiff_t len = strlen(path);
+    return len >= 5 && (!memcmp(path + len - 5, ".tscn", 5) || !memcmp(path + len - 5, ".tres", 5));
+}
+
+ptrdiff_t ts_async_request(TS_Async_Loader *loader, char *path)
+{
+    char resolved[TS_ASYNC_PATH_MAX];
+    if (!ts_async_resolve(loader, path, resolved))
+    {
+        return -1;
+    }
+
+    // Never 0, that marks an empty slot
+    int64_t key = (int64_t)(ts_hash(TS_FNV_OFFSET, U(resolved, strlen(resolved))) | 1);
+    for (int64_t i = key & loader->slots_mask, probes = 0; probes <= loader->slots_mask; i = (i + 1) & loader->slots_mask, probes++)
+    {
+        TS_Asset_Slot *slot = &loader->slots[i];
+        TS_Asset *asset = &loader->assets[i];
+
+        int64_t seen = ts_atomic_load(&slot->key);
+        if (!seen && ts_atomic_cas(&slot->key, 0, key))
+        {
+            memcpy(asset->path, resolved, strlen(resolved) + 1);
+            asset->kind = ts_is_scene_path(resolved) ? TS_Asset_Scene : TS_Asset_File;
+            ts_atomic_store(&slot->published, 1);
+
+            if (!ts_queue_push(&loader->jobs, i))
+            {
+                return -1; // unreachable, the ring holds every slot
+            }
+            ts_semaphore_post(&loader->wake);
+            return (ptrdiff_t) i;
+        }
+
+        seen = ts_atomic_load(&slot->key);
+        if (seen == key)
+        {
+            while (!ts_atomic_load(&slot->published))
+            {
+                ts_yield();
+            }
+            if (!strcmp(asset->path, resolved))
+            {
+                return (ptrdiff_t) i;
+            }
+        }
+    }
+    return -1;
+}
+
+static void ts_async_read_file(TS_Asset *asset)
+{
+    FILE *file = fopen(asset->path, "rb");
+    if (!file)
+    {
+        return;
+    }
+
+    long len = fseek(file, 0, SEEK_END) ? -1 : ftell(file);
+    if (len >= 0 && !fseek(file, 0, SEEK_SET))
+    {
+        asset->data = malloc(len ? len : 1);
+        if (asset->data && (long) fread(asset->data, 1, len, file) == len)
+        {
+            asset->data_len = len;
+            asset->ok = 1;
+        }
+    }
+    fclose(file);
+}
+
+// Schedules every ext_resource before the scene is reported, so a poller that
+// sees the scene can already walk its dependencies
+static void ts_async_load_scene(TS_Async_Loader *loader, TS_Asset *asset)
+{
+    asset->scene = ts_load_file(asset->path, 0);
+    asset->ok    = asset->scene.ok;
+    if (!asset->ok || !asset->scene.ext_resources_len)
+    {
+        return;
+    }
+
+    asset->dependencies = malloc(asset->scene.ext_resources_len * sizeof(ptrdiff_t));
+    if (!asset->dependencies)
+    {
+        asset->ok = 0;
+        return;
+    }
+
+    for (ptrdiff_t i = 0; i < asset->scene.ext_resources_len; i++)
+    {
+        TS_Chunk *chunk = &asset->scene.chunks[asset->scene.ext_resources[i].chunk];
+        TS_Pair *pair = ts_chunk_heading_get(chunk, "path", 4);
+
+        char path[TS_ASYNC_PATH_MAX];
+        ptrdiff_t dependency = -1;
+        if (pair && pair->value.len < TS_ASYNC_PATH_MAX)
+        {
+            memcpy(path, pair->value.data, pair->value.len);
+            ptrdiff_t len = pair->flags & TS_Pair_Escaped ? ts_unescape(path, pair->value.len) : pair->value.len;
+            path[len] = 0;
+            dependency = ts_async_request(loader, path);
+        }
+        asset->dependencies[i] = dependency;
+    }
+    asset->dependencies_len = asset->scene.ext_resources_len;
+}
+
+#ifdef _WIN32
+static unsigned long __stdcall ts_async_worker(void *arg)
+#else
+static void *ts_async_worker(void *arg)
+#endif
+{
+    TS_Async_Loader *loader = arg;
+    for (;;)
+    {
+        ts_semaphore_wait(&loader->wake);
+        if (ts_atomic_load(&loader->stop))
+        {
+            return 0; // queued jobs are dropped
+        }
+
+        // A post means a job is published, but an earlier claimed cell may still be
+        // mid write, which makes the pop miss until that producer finishes
+        int64_t job;
+        while (!ts_queue_pop(&loader->jobs, &job))
+        {
+            if (ts_atomic_load(&loader->stop))
+            {
+                return 0;
+            }
+            ts_yield();
+        }
+
+        TS_Asset *asset = &loader->assets[job];
+        if (asset->kind == TS_Asset_Scene)
+        {
+            ts_async_load_scene(loader, asset);
+        }
+        else
+        {
+            ts_async_read_file(asset);
+        }
+        ts_queue_push(&loader->finished, job);
+    }
+}
+
+TS_Async_Loader *ts_async_begin(char *root, int threads)
+{
+    TS_Async_Loader *loader = calloc(1, sizeof(TS_Async_Loader));
+    if (!loader || strlen(root) >= TS_ASYNC_PATH_MAX)
+    {
+        free(loader);
+        return 0;
+    }
+    memcpy(loader->root, root, strlen(root) + 1);
+
+    int64_t cap = 1;
+    while (cap < TS_ASYNC_MAX_ASSETS)
+    {
+        cap *= 2;
+    }
+    loader->slots_mask = cap - 1;
+    loader->assets = calloc(cap, sizeof(TS_Asset));
+    loader->slots  = calloc(cap, sizeof(TS_Asset_Slot));
+    if (!loader->assets || !loader->slots ||
+        !ts_queue_init(&loader->jobs, cap) || !ts_queue_init(&loader->finished, cap) ||
+        !ts_semaphore_init(&loader->wake))
+    {
+        free(loader->assets);
+        free(loader->slots);
+        free(loader->jobs.cells);
+        free(loader->finished.cells);
+        free(loader);
+        return 0;
+    }
+
+    threads = threads < 1 ? 1 : threads > TS_ASYNC_MAX_THREADS ? TS_ASYNC_MAX_THREADS : threads;
+    for (int i = 0; i < threads; i++)
+    {
+#ifdef _WIN32
+        loader->threads[i] = CreateThread(0, 0, ts_async_worker, loader, 0, 0);
+        _Bool started = loader->threads[i] != 0;
+#else
+        _Bool started = !pthread_create(&loader->threads[i], 0, ts_async_worker, loader);
+#endif
+        if (!started)
+        {
+            break;
+        }
+        loader->threads_len += 1;
+    }
+    if (!loader->threads_len)
+    {
+        ts_async_end(loader);
+        return 0;
+    }
+    return loader;
+}
+
+TS_Asset *ts_async_asset(TS_Async_Loader *loader, ptrdiff_t asset)
+{
+    return asset >= 0 && asset <= loader->slots_mask ? &loader->assets[asset] : 0;
+}
+
+ptrdiff_t ts_async_poll(TS_Async_Loader *loader)
+{
+    int64_t asset;
+    if (!ts_queue_pop(&loader->finished, &asset))
+    {
+        return -1;
+    }
+    loader->assets[asset].done = 1;
+    return (ptrdiff_t) asset;
+}
+
+static _Bool ts_async_visit(TS_Async_Loader *loader, ptrdiff_t asset)
+{
+    if (asset < 0 || loader->slots[asset].mark == loader->ready_mark)
+    {
+        return 1; // unschedulable dependencies never arrive, and cycles end here
+    }
+    loader->slots[asset].mark = loader->ready_mark;
+
+    TS_Asset *a = &loader->assets[asset];
+    if (!a->done)
+    {
+        return 0;
+    }
+    for (ptrdiff_t i = 0; i < a->dependencies_len; i++)
+    {
+        if (!ts_async_visit(loader, a->dependencies[i]))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+_Bool ts_async_ready(TS_Async_Loader *loader, ptrdiff_t asset)
+{
+    loader->ready_mark += 1;
+    return asset >= 0 && ts_async_visit(loader, asset);
+}
+
+void ts_async_end(TS_Async_Loader *loader)
+{
+    if (!loader)
+    {
+        return;
+    }
+
+    ts_atomic_store(&loader->stop, 1);
+    for (int i = 0; i < loader->threads_len; i++)
+    {
+        ts_semaphore_post(&loader->wake);
+    }
+    for (int i = 0; i < loader->threads_len; i++)
+    {
+#ifdef _WIN32
+        WaitForSingleObject(loader->threads[i], 0xffffffff /* INFINITE */);
+        CloseHandle(loader->threads[i]);
+#else
+        pthread_join(loader->threads[i], 0);
+#endif
+    }
+
+    for (int64_t i = 0; i <= loader->slots_mask; i++)
+    {
+        TS_Asset *asset = &loader->assets[i];
+        ts_unload(asset->scene);
+        free(asset->data);
+        free(asset->dependencies);
+    }
+
+    ts_semaphore_free(&loader->wake);
+    free(loader->assets);
+    free(loader->slots);
+    free(loader->jobs.cells);
+    free(loader->finished.cells);
+    free(loader);
+}
+
+#endif // TEXT_SCENE_IGNORE_STDLIB
 
 #undef S
 #undef U
-#undef new
+#undef push
+#undef ts_assert
 
+#endif // TEXT_SCENE_C
@@ -1,6 +1,7 @@
 #ifndef TEXT_SCENE_H
 #define TEXT_SCENE_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 typedef struct
@@ -8,18 +9,31 @@ typedef struct
     void *(*malloc)(ptrdiff_t, void *ctx);
     void  (*free)(void *, void *ctx);
     void   *ctx;
+
+    // Optional. Grows an allocation in place and returns it, NULL when it
+    // cannot, growable buffers then copy to a new allocation instead.
+    // ts_load2 sizes its buffers up front for allocators that have it.
+    void *(*resize)(void *ptr, ptrdiff_t old_size, ptrdiff_t new_size, void *ctx);
 } TS_Allocator;
 
 typedef enum
 {
     TS_Heading_Nothing,
-    TS_Heading_File_Descriptor,
+    TS_Heading_File_Descriptor, // [gd_scene] or [gd_resource]
     TS_Heading_Ext_Resource,
     TS_Heading_Sub_Resource,
     TS_Heading_Node,
     TS_Heading_Connection,
+    TS_Heading_Resource,        // the [resource] section of a .tres
 } TS_Heading;
 
+typedef enum
+{
+    TS_Pair_Quoted  = 1 << 0, // value was a quoted string, the quotes are already stripped
+    TS_Pair_Escaped = 1 << 1, // read only load, value still holds escapes, see ts_unescape_pair
+    TS_Pair_Dirty   = 1 << 2, // value was edited, ts_save escapes it instead of copying `raw`
+} TS_Pair_Flag;
+
 typedef struct
 {
     struct
@@ -33,8 +47,134 @@ typedef struct
         char *data;
         ptrdiff_t len;
     } value;
+
+    // The value exactly as written, escapes and all but without quotes. Set by
+    // the loaders so ts_save can copy values that were not edited, NULL for
+    // pairs from ts_stream.
+    struct
+    {
+        char *data;
+        ptrdiff_t len;
+    } raw;
+
+    // Where the value sits in the loaded source, quotes included. ts_save
+    // copies the source around it and rewrites only this part, NULL for pairs
+    // from ts_stream.
+    struct
+    {
+        char *data;
+        ptrdiff_t len;
+    } span;
+
+    int flags; // TS_Pair_Flag
 } TS_Pair;
 
+typedef enum
+{
+    TS_Variant_Raw,          // could not be decoded, `string` holds the whole value
+    TS_Variant_Nil,
+    TS_Variant_Bool,
+    TS_Variant_Int,
+    TS_Variant_Float,
+    TS_Variant_String,       // nested strings keep their escape sequences
+    TS_Variant_String_Name,  // &"name"
+    TS_Variant_Node_Path,    // NodePath("path") or ^"path"
+    TS_Variant_Vector2,      // f[0..1]
+    TS_Variant_Vector2i,     // i[0..1]
+    TS_Variant_Vector3,      // f[0..2]
+    TS_Variant_Vector3i,     // i[0..2]
+    TS_Variant_Vector4,      // f[0..3]
+    TS_Variant_Vector4i,     // i[0..3]
+    TS_Variant_Rect2,        // f[0..3] as x, y, width, height
+    TS_Variant_Rect2i,       // i[0..3]
+    TS_Variant_Color,        // f[0..3] as r, g, b, a
+    TS_Variant_Quaternion,   // f[0..3]
+    TS_Variant_Plane,        // f[0..3]
+    TS_Variant_Transform2D,  // f[0..5] as x axis, y axis, origin
+    TS_Variant_Ext_Resource, // `resource` holds the id and, once loaded, its index
+    TS_Variant_Sub_Resource, // `resource` holds the id and, once loaded, its index
+    TS_Variant_Array,
+    TS_Variant_Dictionary,   // items alternate key, value. `len` counts entries
+    TS_Variant_Constructor,  // any other Name(...), packed arrays go through ts_decode_packed
+} TS_Variant_Type;
+
+typedef struct TS_Variant TS_Variant;
+struct TS_Variant
+{
+    TS_Variant_Type type;
+    union
+    {
+        _Bool boolean;
+        int64_t integer;
+        double real;
+        float f[6];
+        int32_t i[6];
+
+        struct
+        {
+            char *data;
+            ptrdiff_t len;
+        } string;
+
+        // Shares its first fields with `string`
+        struct
+        {
+            char *data;
+            ptrdiff_t len;
+            int32_t index; // into ext_resources or sub_resources, -1 if the id was not defined
+        } resource;
+
+        struct
+        {
+            TS_Variant *items;
+            ptrdiff_t len;
+        } array;
+
+        struct
+        {
+            struct
+            {
+                char *data;
+                ptrdiff_t len;
+            } name, args;
+        } constructor;
+    };
+};
+
+typedef struct
+{
+    _Bool ok;
+    TS_Variant variant;
+} TS_Variant_Result;
+
+typedef enum
+{
+    TS_Packed_None,
+    TS_Packed_Byte,    // uint8_t
+    TS_Packed_Int32,   // int32_t
+    TS_Packed_Int64,   // int64_t
+    TS_Packed_Float32, // float
+    TS_Packed_Float64, // double
+    TS_Packed_Vector2, // float[2]
+    TS_Packed_Vector3, // float[3]
+    TS_Packed_Vector4, // float[4]
+    TS_Packed_Color,   // float[4]
+} TS_Packed_Type;
+
+typedef struct
+{
+    _Bool ok;
+    TS_Packed_Type type;
+    ptrdiff_t len;  // elements, a Vector2 counts once
+    ptrdiff_t size; // bytes ts_decode_packed writes
+} TS_Packed_Info;
+
+typedef enum
+{
+    TS_Load_Decode_Values = 1 << 0, // fill TS_Load_Result.values while loading
+    TS_Load_Read_Only     = 1 << 1, // never write to the source, escapes are resolved on access
+} TS_Load_Flags;
+
 typedef struct
 {
     struct {
@@ -47,8 +187,80 @@ typedef struct
 
     ptrdiff_t heading_pairs_len;
     ptrdiff_t pairs_len;
+
+    int32_t *key_map;      // see ts_chunk_get, NULL for chunks with few keys
+    ptrdiff_t key_map_cap;
+
+    // The source from the heading up to the next one, blank lines and comments
+    // included. The first chunk's also holds whatever comes before its heading.
+    // NULL for chunks from ts_stream.
+    struct {
+        char *data;
+        ptrdiff_t len;
+    } text;
 } TS_Chunk;
 
+// Scene tree built from the name and parent heading pairs. Links are indices
+// into TS_Load_Result.nodes, -1 when absent. Children stay in file order.
+typedef struct
+{
+    ptrdiff_t chunk;
+    ptrdiff_t parent;       // -1 for the root, and for nodes whose parent is not in this file
+    ptrdiff_t first_child;
+    ptrdiff_t next_sibling;
+
+    struct
+    {
+        char *data;
+        ptrdiff_t len;
+    } name;
+
+    uint64_t path_hash;     // of the NodePath relative to the root, "." for the root itself
+} TS_Node;
+
+// One entry per [ext_resource] or [sub_resource] chunk, in file order
+typedef struct
+{
+    ptrdiff_t chunk;
+
+    struct
+    {
+        char *data;
+        ptrdiff_t len;
+    } id;
+} TS_Resource;
+
+// What a pair's value refers to when it is ExtResource("...") or SubResource("...")
+typedef struct
+{
+    TS_Heading heading; // TS_Heading_Ext_Resource, TS_Heading_Sub_Resource or TS_Heading_Nothing
+    int index;          // into ext_resources or sub_resources, -1 if the id was not defined
+} TS_Resource_Handle;
+
+// A [connection] chunk compiled against the node tree. Signal and method
+// names are interned into TS_Load_Result.names.
+typedef struct
+{
+    int32_t from;      // node index
+    int32_t signal;    // name id
+    int32_t to;        // node index
+    int32_t method;    // name id
+    int32_t flags;     // CONNECT_* bits from the heading
+    ptrdiff_t chunk;   // for binds and unbinds
+} TS_Connection;
+
+typedef struct
+{
+    TS_Connection *connections;
+    ptrdiff_t len;
+} TS_Connection_Range;
+
+typedef struct
+{
+    char *data;
+    ptrdiff_t len;
+} TS_Name;
+
 typedef struct
 {
     _Bool ok;
@@ -57,8 +269,81 @@ typedef struct
 
     TS_Pair *all_pairs;
     ptrdiff_t all_pairs_len;
+
+    TS_Variant *values; // parallel to all_pairs, only with TS_Load_Decode_Values
+    void *arena;        // blocks holding decoded arrays and dictionaries
+
+    int32_t *key_maps;  // every chunk's key_map, open addressed on key, pair index + 1 or -(heading pair index + 1)
+    ptrdiff_t key_maps_len;
+
+    TS_Node *nodes;     // every [node] chunk in file order, nodes[0] is the root
+    ptrdiff_t nodes_len;
+    ptrdiff_t *node_map; // open addressed on path_hash, holds node index + 1
+    ptrdiff_t node_map_cap;
+
+    TS_Resource *ext_resources;
+    ptrdiff_t ext_resources_len;
+    TS_Resource *sub_resources;
+    ptrdiff_t sub_resources_len;
+    TS_Resource_Handle *resource_handles; // parallel to all_pairs
+    ptrdiff_t *resource_map; // open addressed on id, holds ext index + 1 or -(sub index + 1)
+    ptrdiff_t resource_map_cap;
+
+    TS_Connection *connections; // by from, then signal, then file order. Connections to nodes outside the file are left out
+    ptrdiff_t connections_len;
+    ptrdiff_t *node_connections; // node i's connections start at node_connections[i] and end at node_connections[i + 1]
+    TS_Name *names;
+    ptrdiff_t names_len;
+    ptrdiff_t *name_map;   // open addressed on name, holds name id + 1
+    ptrdiff_t name_map_cap;
+
+    void *mapping;      // set when the result came from the scene cache
+    ptrdiff_t mapping_len;
+    void *source_mapping; // set by ts_load_file
+    ptrdiff_t source_mapping_len;
 } TS_Load_Result;
 
+// One growable arena for everything ts_load2 allocates. Resetting keeps the
+// memory, so loading level sections of a similar size mallocs nothing once warm.
+typedef struct
+{
+    TS_Allocator allocator; // draws from the arena, also usable for ts_decode_value and friends
+    TS_Allocator backing;
+    void *blocks;
+    char *beg;
+    char *end;
+    void *last;             // newest allocation, the only one free gives back
+    ptrdiff_t used;         // bytes handed out since the last reset
+    ptrdiff_t high_water;   // most that `used` has reached
+    ptrdiff_t capacity;     // bytes held from the backing allocator
+} TS_Loader;
+
+typedef enum
+{
+    TS_Change_Node_Removed,       // old_node, children come before their parents
+    TS_Change_Node_Added,         // new_node, parents come before their children
+    TS_Change_Property_Set,       // new_pair on new_node, old_pair is -1 for a new key
+    TS_Change_Property_Removed,   // old_pair, the key is gone from new_node
+    TS_Change_Children_Reordered, // new_node keeps children whose order changed
+} TS_Change_Kind;
+
+// Pair indices are into each result's all_pairs, heading pairs included
+typedef struct
+{
+    TS_Change_Kind kind;
+    ptrdiff_t old_node;
+    ptrdiff_t new_node;
+    ptrdiff_t old_pair;
+    ptrdiff_t new_pair;
+} TS_Change;
+
+typedef struct
+{
+    _Bool ok;
+    TS_Change *changes; // removals, then every new node in file order with its own changes
+    ptrdiff_t changes_len;
+} TS_Diff;
+
 typedef struct
 {
     _Bool ok;
@@ -66,8 +351,255 @@ typedef struct
     ptrdiff_t output_len;
 } TS_Save_Result;
 
+#ifndef TS_TILE_CHUNK_SIZE
+#define TS_TILE_CHUNK_SIZE 32
+#endif
+#define TS_TILE_EMPTY 0xffff
+
+typedef struct
+{
+    uint16_t source; // TileSet source id, TS_TILE_EMPTY for no tile
+    uint16_t atlas_x;
+    uint16_t atlas_y;
+    uint16_t alternative;
+} TS_Tile;
+
+typedef struct
+{
+    int32_t x;     // in chunks, a tile's coordinate divided by TS_TILE_CHUNK_SIZE rounding down
+    int32_t y;
+    int32_t count; // tiles that are not empty
+    _Bool dirty;   // set by every ts_tile_set, loading included. Clear it after redrawing the chunk.
+    TS_Tile tiles[TS_TILE_CHUNK_SIZE * TS_TILE_CHUNK_SIZE]; // row major
+} TS_Tile_Chunk;
+
+// Sparse tile map, only chunks holding a tile exist
+typedef struct
+{
+    _Bool ok;
+    TS_Tile_Chunk *chunks; // indices are stable, addresses move as chunks are added
+    ptrdiff_t chunks_len;
+    ptrdiff_t chunks_cap;
+    ptrdiff_t *chunk_map;  // open addressed on chunk coordinates, holds chunk index + 1
+    ptrdiff_t chunk_map_cap;
+} TS_Tile_Grid;
+
+// Callbacks for ts_stream_feed, any may be NULL. Slices point into the fed data
+// or the stream's line buffer and are only valid during the call.
+typedef struct
+{
+    void (*heading)(TS_Chunk chunk, void *ctx); // only `heading` and `source` (the section name) are set
+    void (*heading_pair)(TS_Pair pair, void *ctx);
+    void (*pair)(TS_Pair pair, void *ctx);
+    void *ctx;
+} TS_Stream_Callbacks;
+
+// Where a logical line stands, a value spanning lines keeps brackets or a string open
+typedef struct
+{
+    int depth;
+    _Bool in_string;
+    _Bool escaped;
+} TS_Line_Scan;
+
+typedef struct
+{
+    _Bool ok;
+    TS_Stream_Callbacks callbacks;
+    TS_Allocator allocator;
+
+    struct
+    {
+        char *data;
+        ptrdiff_t len;
+        ptrdiff_t cap; // grows to the longest line cut by a feed boundary, then stays
+    } line;
+
+    TS_Line_Scan scan;
+    _Bool in_chunk;
+} TS_Stream;
+
+#ifndef TS_STREAM_READ_SIZE
+#define TS_STREAM_READ_SIZE (64 << 10)
+#endif
+
+// Every node of one `type`, one array per property. Entity ids are dense,
+// a scene template uses its node indices and each instance adds an offset.
+typedef struct
+{
+    struct
+    {
+        char *data;
+        ptrdiff_t len;
+    } type;
+
+    ptrdiff_t len;
+    ptrdiff_t cap;
+
+    float *position_x;
+    float *position_y;
+    float *rotation;
+    float *scale_x;
+    float *scale_y;
+    int32_t *entity;
+    int32_t *parent;  // entity id, -1 for a root
+    int32_t *texture; // index into the scene's ext_resources, -1 for none
+    _Bool *visible;
+} TS_Entity_Group;
+
+typedef struct
+{
+    _Bool ok;
+    TS_Entity_Group *groups;
+    ptrdiff_t groups_len;
+    ptrdiff_t groups_cap;
+    ptrdiff_t entities_len; // ids handed out so far
+} TS_Entity_Store;
+
+#ifndef TS_ASYNC_PATH_MAX
+#define TS_ASYNC_PATH_MAX 260
+#endif
+#ifndef TS_ASYNC_MAX_ASSETS
+#define TS_ASYNC_MAX_ASSETS 1024 // a power of two, asset indices stay below it
+#endif
+#ifndef TS_ASYNC_MAX_THREADS
+#define TS_ASYNC_MAX_THREADS 16
+#endif
+
+typedef enum
+{
+    TS_Asset_Scene, // .tscn or .tres, parsed with ts_load_file
+    TS_Asset_File,  // anything else, read whole for the caller to decode
+} TS_Asset_Kind;
+
+// Written by one worker, then handed to the main thread by ts_async_poll.
+// Read nothing but `path` before the asset has been polled.
+typedef struct
+{
+    char path[TS_ASYNC_PATH_MAX]; // on disk, res:// already resolved
+    TS_Asset_Kind kind;
+    _Bool ok;
+    _Bool done;                   // polled, main thread only
+
+    TS_Load_Result scene;
+    char *data;                   // from malloc, once polled it may be freed and set to NULL
+    ptrdiff_t data_len;
+
+    ptrdiff_t *dependencies;      // asset per ext_resource in file order, -1 if it could not be scheduled
+    ptrdiff_t dependencies_len;
+} TS_Asset;
+
+typedef struct TS_Async_Loader TS_Async_Loader;
+
 TS_Load_Result ts_load(char *source);
 TS_Load_Result ts_load1(char *source, ptrdiff_t source_len, TS_Allocator *allocator);
+TS_Load_Result ts_load2(char *source, ptrdiff_t source_len, TS_Allocator *allocator, TS_Load_Flags flags);
+
+// Frees a ts_load1 or ts_load2 result through the allocator it was loaded with
+void ts_unload1(TS_Load_Result result, TS_Allocator *allocator);
+
+// Results from ts_loader_load live until the next ts_loader_reset, never unload them
+void ts_loader_init(TS_Loader *loader, TS_Allocator *backing);
+TS_Load_Result ts_loader_load(TS_Loader *loader, char *source, ptrdiff_t source_len, TS_Load_Flags flags);
+void ts_loader_reset(TS_Loader *loader);
+void ts_loader_free(TS_Loader *loader);
+
+// Decodes a value slice. Nested arrays and dictionaries share one allocation,
+// release it with ts_free_variant.
+TS_Variant_Result ts_decode_value(char *value, ptrdiff_t value_len, _Bool quoted, TS_Allocator *allocator);
+TS_Variant_Result ts_decode_pair(TS_Pair pair, TS_Allocator *allocator);
+void ts_free_variant(TS_Variant variant, TS_Allocator *allocator);
+
+// Packed*Array(...) values, including Godot 3's Pool*Array. ts_packed_info sizes
+// the output by counting separators, ts_decode_packed then fills a caller owned
+// buffer aligned for the element's scalar type.
+TS_Packed_Info ts_packed_info(char *value, ptrdiff_t value_len);
+_Bool ts_decode_packed(char *value, ptrdiff_t value_len, void *out, ptrdiff_t out_size);
+
+// Pair for `key` in a loaded chunk, NULL if missing. Chunks with many keys
+// carry a hash index built at load time, small ones are scanned.
+TS_Pair *ts_chunk_get(TS_Chunk *chunk, char *key, ptrdiff_t key_len);
+TS_Pair *ts_chunk_heading_get(TS_Chunk *chunk, char *key, ptrdiff_t key_len);
+
+// Node index for a path such as "Level/Enemies" or "." for the root, -1 if missing
+ptrdiff_t ts_find_node(TS_Load_Result *result, char *path, ptrdiff_t path_len);
+
+// Index into ext_resources or sub_resources, `heading` picks which, -1 if missing
+ptrdiff_t ts_find_resource(TS_Load_Result *result, TS_Heading heading, char *id, ptrdiff_t id_len);
+
+// Name id for a signal or method, -1 if no connection uses it. Look it up
+// once, then emit with ts_find_connections.
+ptrdiff_t ts_find_name(TS_Load_Result *result, char *name, ptrdiff_t name_len);
+TS_Connection_Range ts_find_connections(TS_Load_Result *result, ptrdiff_t node, ptrdiff_t signal);
+
+// What changed between two loads of a scene, nodes matched by NodePath and
+// properties by key. A node whose type or instanced scene changed is removed
+// and added again with its children. Values compare as text, so load both the
+// same way.
+TS_Diff ts_diff(TS_Load_Result *from, TS_Load_Result *to, TS_Allocator *allocator);
+void ts_diff_free(TS_Diff *diff, TS_Allocator *allocator);
+
+// Scene cache keyed by a hash of the source. A hit maps the cooked file from
+// `cache_dir` and only relocates it, a miss loads with ts_load2 and writes the file.
+// A cooked file that fails its bounds checks is treated as a miss.
+// Release either kind of result with ts_unload.
+TS_Load_Result ts_load_cached(char *source, ptrdiff_t source_len, char *cache_dir, TS_Load_Flags flags);
+void ts_unload(TS_Load_Result result);
+
+// Maps the file read only and loads it with TS_Load_Read_Only, release with ts_unload
+TS_Load_Result ts_load_file(char *path, TS_Load_Flags flags);
+
+// Resolves a TS_Pair_Escaped value on first access. The unescaped copy goes in
+// the result's arena and the pair is repointed at it. Returns 0 when out of memory.
+_Bool ts_unescape_pair(TS_Load_Result *result, TS_Pair *pair, TS_Allocator *allocator);
+uint64_t ts_source_hash(char *source, ptrdiff_t source_len);
+
+// Groups a loaded scene's nodes by type and decodes their transform, visibility
+// and texture once. Type names point into the scene's source.
+TS_Entity_Store ts_entity_template(TS_Load_Result *scene, TS_Allocator *allocator);
+// Appends `count` copies of a template to `store`, returns the first new entity
+// id. Returns -1 and leaves `store` as it was when out of memory, when the ids
+// would pass INT32_MAX, for a negative count or when `store` is the template.
+ptrdiff_t ts_instantiate(TS_Entity_Store *store, TS_Entity_Store *scene_template, ptrdiff_t count, TS_Allocator *allocator);
+void ts_entity_store_free(TS_Entity_Store *store, TS_Allocator *allocator);
+
+// Decodes a TileMap node's layer_N/tile_data, or a TileMapLayer's tile_map_data
+// when `layer` is 0. The grid owns its tiles, the scene can be unloaded after.
+TS_Tile_Grid ts_tile_grid_from_node(TS_Load_Result *scene, ptrdiff_t node, int layer, TS_Allocator *allocator);
+_Bool ts_tile_grid_import(TS_Tile_Grid *grid, char *value, ptrdiff_t value_len, TS_Allocator *allocator);
+void ts_tile_grid_free(TS_Tile_Grid *grid, TS_Allocator *allocator);
+ptrdiff_t ts_tile_chunk_find(TS_Tile_Grid *grid, int32_t chunk_x, int32_t chunk_y); // chunk index or -1
+TS_Tile ts_tile_get(TS_Tile_Grid *grid, int32_t x, int32_t y);
+_Bool ts_tile_set(TS_Tile_Grid *grid, int32_t x, int32_t y, TS_Tile tile, TS_Allocator *allocator);
+// Copies a width by height block, row major, into `out`. Returns how many tiles are not empty.
+ptrdiff_t ts_tile_rect(TS_Tile_Grid *grid, int32_t x, int32_t y, int32_t width, int32_t height, TS_Tile *out);
+
+// Parses a scene fed in pieces of any size without holding more than one logical
+// line, values spanning lines included. Fed data is unescaped in place like ts_load2.
+TS_Stream ts_stream_begin(TS_Stream_Callbacks callbacks, TS_Allocator *allocator);
+_Bool ts_stream_feed(TS_Stream *stream, char *data, ptrdiff_t len);
+_Bool ts_stream_end(TS_Stream *stream); // flushes a last line without a newline and frees the line buffer
+// Reads `fd` to the end in TS_STREAM_READ_SIZE pieces
+_Bool ts_stream_fd(int fd, TS_Stream_Callbacks callbacks, TS_Allocator *allocator);
+
+// Loads scenes and everything their ext_resources reference on a worker pool.
+// A path is only ever loaded once. Finished assets come back one at a time
+// from ts_async_poll, a lock free queue meant to be drained every frame.
+TS_Async_Loader *ts_async_begin(char *root, int threads); // `root` stands in for res://
+ptrdiff_t ts_async_request(TS_Async_Loader *loader, char *path); // asset index, -1 when the table is full
+TS_Asset *ts_async_asset(TS_Async_Loader *loader, ptrdiff_t asset);
+ptrdiff_t ts_async_poll(TS_Async_Loader *loader); // a newly finished asset or -1, main thread only
+_Bool ts_async_ready(TS_Async_Loader *loader, ptrdiff_t asset); // it and all it depends on were polled
+void ts_async_end(TS_Async_Loader *loader); // drops unfinished jobs and frees every asset
+
+// Points `pair` at a new value and marks it dirty. The value is not copied
+// and must outlive any ts_save of its chunk.
+void ts_set_value(TS_Pair *pair, char *value, ptrdiff_t value_len, _Bool quoted);
+
+// A loaded chunk is copied from its `text` with only the values edited by
+// ts_set_value rewritten, so spacing and comments survive and an unedited scene
+// saves back byte for byte. Chunks without `text`, or whose pairs no longer
+// follow it in order, are written in Godot's own layout instead.
 TS_Save_Result ts_save(TS_Chunk *chunks, ptrdiff_t chunks_len, char *savepath);
 TS_Save_Result ts_save1(TS_Chunk *chunks, ptrdiff_t chunks_len, TS_Allocator *allocator);
 
@@ -0,0 +1,771 @@
+/*
+ *  ts_bench.c - load throughput benchmark and equivalence checker for text_scene.c
+ *
+ *  Benchmark, prints one JSON object per line and checks every alternative
+ *  loader against ts_load1 on the way, and that ts_save1 writes the source back:
+ *      cc -O2 ts_bench.c -o ts_bench
+ *      ./ts_bench [max_bytes]
+ *
+ *  Corpus sizes run from 10 KB to 500 MB, max_bytes defaults to 16 MB. The
+ *  cache and file loaders go through ./ts_bench_cache, which is removed again.
+ *
+ *  Checker only, for real scenes:
+ *      ./ts_bench --check level.tscn enemy.tscn ...
+ */
+
+#define TS_IMPLEMENTATION
+#include "text_scene.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+
+#define assert(c) if (!(c)) __builtin_trap()
+
+typedef struct
+{
+    char *data;
+    ptrdiff_t len;
+    ptrdiff_t cap;
+} Buffer;
+
+static void append(Buffer *b, char *format, ...)
+{
+    for (;;)
+    {
+        va_list args;
+        va_start(args, format);
+        int len = vsnprintf(b->data + b->len, b->cap - b->len, format, args);
+        va_end(args);
+
+        if (len < b->cap - b->len)
+        {
+            b->len += len;
+            return;
+        }
+
+        b->cap  = b->cap ? b->cap * 2 : 1 << 16;
+        b->data = realloc(b->data, b->cap);
+        assert(b->data);
+    }
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15;
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t) rng_state;
+}
+
+/* Peak memory */
+
+// Sizes are kept in front of each block so frees can be counted
+typedef struct
+{
+    ptrdiff_t live;
+    ptrdiff_t peak;
+    ptrdiff_t allocations;
+} Counting_Allocator;
+
+#define COUNT_HEADER 16
+
+static void *counting_malloc(ptrdiff_t size, void *ctx)
+{
+    Counting_Allocator *counter = ctx;
+    char *block = malloc(COUNT_HEADER + size);
+    if (!block)
+    {
+        return 0;
+    }
+    memcpy(block, &size, sizeof(size));
+
+    counter->allocations += 1;
+    counter->live += size;
+    counter->peak  = counter->live > counter->peak ? counter->live : counter->peak;
+    return block + COUNT_HEADER;
+}
+
+static void counting_free(void *ptr, void *ctx)
+{
+    Counting_Allocator *counter = ctx;
+    char *block = (char *) ptr - COUNT_HEADER;
+    ptrdiff_t size;
+    memcpy(&size, block, sizeof(size));
+    counter->live -= size;
+    free(block);
+}
+
+static TS_Allocator counting_allocator(Counting_Allocator *counter)
+{
+    TS_Allocator allocator = {0};
+    allocator.malloc = &counting_malloc;
+    allocator.free   = &counting_free;
+    allocator.ctx    = counter;
+    return allocator;
+}
+
+/* Equivalence */
+
+// Two results agree when they describe the same scene, slices are compared by
+// content since another loader may keep them anywhere
+
+static _Bool same_slice(char *a, ptrdiff_t a_len, char *b, ptrdiff_t b_len)
+{
+    return a_len == b_len && (!a_len || !memcmp(a, b, a_len));
+}
+
+// Read only loads leave escapes in place, resolve them on a copy first
+static _Bool same_pair(TS_Pair a, TS_Pair b)
+{
+    char small[256];
+    char *copy = 0;
+    if (b.flags & TS_Pair_Escaped)
+    {
+        copy = b.value.len <= (ptrdiff_t) sizeof(small) ? small : malloc(b.value.len);
+        memcpy(copy, b.value.data, b.value.len);
+        b.value.data = copy;
+        b.value.len  = ts_unescape(copy, b.value.len);
+        b.flags &= ~TS_Pair_Escaped;
+    }
+
+    _Bool same = a.flags == b.flags &&
+                 same_slice(a.key.data, a.key.len, b.key.data, b.key.len) &&
+                 same_slice(a.value.data, a.value.len, b.value.data, b.value.len);
+    if (copy != small)
+    {
+        free(copy);
+    }
+    return same;
+}
+
+static _Bool same_variant(TS_Variant a, TS_Variant b)
+{
+    if (a.type != b.type)
+    {
+        return 0;
+    }
+
+    switch (a.type)
+    {
+    case TS_Variant_Raw:
+    case TS_Variant_String:
+    case TS_Variant_String_Name:
+    case TS_Variant_Node_Path:
+    case TS_Variant_Ext_Resource:
+    case TS_Variant_Sub_Resource:
+    case TS_Variant_Constructor:
+        return same_slice(a.string.data, a.string.len, b.string.data, b.string.len);
+    case TS_Variant_Array:
+    case TS_Variant_Dictionary:
+    {
+        if (a.array.len != b.array.len)
+        {
+            return 0;
+        }
+        ptrdiff_t items = a.type == TS_Variant_Dictionary ? a.array.len * 2 : a.array.len;
+        for (ptrdiff_t i = 0; i < items; i++)
+        {
+            if (!same_variant(a.array.items[i], b.array.items[i])) return 0;
+        }
+        return 1;
+    }
+    case TS_Variant_Nil:
+        return 1;
+    case TS_Variant_Bool:
+        return a.boolean == b.boolean;
+    case TS_Variant_Int:
+        return a.integer == b.integer;
+    case TS_Variant_Float:
+        return !memcmp(&a.real, &b.real, sizeof(a.real));
+    default:
+        return !memcmp(a.f, b.f, sizeof(a.f));
+    }
+}
+
+static _Bool same_chunk(TS_Chunk a, TS_Chunk b)
+{
+    if (a.heading != b.heading ||
+        a.heading_pairs_len != b.heading_pairs_len ||
+        a.pairs_len != b.pairs_len)
+    {
+        return 0;
+    }
+
+    for (ptrdiff_t i = 0; i < a.heading_pairs_len; i++)
+    {
+        if (!same_pair(a.heading_pairs[i], b.heading_pairs[i])) return 0;
+    }
+    for (ptrdiff_t i = 0; i < a.pairs_len; i++)
+    {
+        if (!same_pair(a.pairs[i], b.pairs[i])) return 0;
+    }
+    return 1;
+}
+
+static _Bool same_resources(TS_Resource *a, TS_Resource *b, ptrdiff_t len)
+{
+    for (ptrdiff_t i = 0; i < len; i++)
+    {
+        if (a[i].chunk != b[i].chunk || !same_slice(a[i].id.data, a[i].id.len, b[i].id.data, b[i].id.len))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// `values` are only compared when both sides decoded them
+static _Bool same_scene(TS_Load_Result a, TS_Load_Result b)
+{
+    if (a.ok != b.ok ||
+        a.chunks_len != b.chunks_len ||
+        a.all_pairs_len != b.all_pairs_len ||
+        a.nodes_len != b.nodes_len ||
+        a.ext_resources_len != b.ext_resources_len ||
+        a.sub_resources_len != b.sub_resources_len ||
+        a.connections_len != b.connections_len ||
+        a.names_len != b.names_len)
+    {
+        return 0;
+    }
+
+    for (ptrdiff_t i = 0; i < a.chunks_len; i++)
+    {
+        if (!same_chunk(a.chunks[i], b.chunks[i])) return 0;
+    }
+
+    for (ptrdiff_t i = 0; i < a.nodes_len; i++)
+    {
+        TS_Node x = a.nodes[i];
+        TS_Node y = b.nodes[i];
+        if (x.chunk != y.chunk || x.parent != y.parent ||
+            x.first_child != y.first_child || x.next_sibling != y.next_sibling ||
+            x.path_hash != y.path_hash ||
+            !same_slice(x.name.data, x.name.len, y.name.data, y.name.len))
+        {
+            return 0;
+        }
+    }
+
+    if (!same_resources(a.ext_resources, b.ext_resources, a.ext_resources_len) ||
+        !same_resources(a.sub_resources, b.sub_resources, a.sub_resources_len))
+    {
+        return 0;
+    }
+
+    for (ptrdiff_t i = 0; i < a.all_pairs_len; i++)
+    {
+        if (a.resource_handles[i].heading != b.resource_handles[i].heading ||
+            a.resource_handles[i].index != b.resource_handles[i].index ||
+            (a.values && b.values && !same_variant(a.values[i], b.values[i])))
+        {
+            return 0;
+        }
+    }
+
+    for (ptrdiff_t i = 0; i < a.names_len; i++)
+    {
+        if (!same_slice(a.names[i].data, a.names[i].len, b.names[i].data, b.names[i].len)) return 0;
+    }
+    for (ptrdiff_t i = 0; i < a.connections_len; i++)
+    {
+        TS_Connection x = a.connections[i];
+        TS_Connection y = b.connections[i];
+        if (x.from != y.from || x.signal != y.signal || x.to != y.to ||
+            x.method != y.method || x.flags != y.flags || x.chunk != y.chunk)
+        {
+            return 0;
+        }
+    }
+    if (a.node_connections && memcmp(a.node_connections, b.node_connections, (a.nodes_len + 1) * sizeof(ptrdiff_t)))
+    {
+        return 0;
+    }
+    return 1;
+}
+
+// Follows the reference chunk by chunk as stream events arrive
+typedef struct
+{
+    TS_Load_Result *reference;
+    ptrdiff_t chunk; // index + 1 of the chunk being streamed
+    ptrdiff_t heading_pairs;
+    ptrdiff_t pairs;
+    _Bool same;
+} Stream_Check;
+
+static void check_chunk_done(Stream_Check *check)
+{
+    if (check->chunk)
+    {
+        TS_Chunk done = check->reference->chunks[check->chunk - 1];
+        check->same &= check->heading_pairs == done.heading_pairs_len && check->pairs == done.pairs_len;
+    }
+}
+
+static void check_heading(TS_Chunk chunk, void *ctx)
+{
+    Stream_Check *check = ctx;
+    TS_Load_Result *reference = check->reference;
+    check_chunk_done(check);
+
+    check->chunk += 1;
+    check->heading_pairs = check->pairs = 0;
+    check->same &= check->chunk <= reference->chunks_len && chunk.heading == reference->chunks[check->chunk - 1].heading;
+}
+
+static void check_heading_pair(TS_Pair pair, void *ctx)
+{
+    Stream_Check *check = ctx;
+    if (!check->same) return;
+
+    TS_Chunk chunk = check->reference->chunks[check->chunk - 1];
+    check->same = check->heading_pairs < chunk.heading_pairs_len && same_pair(chunk.heading_pairs[check->heading_pairs], pair);
+    check->heading_pairs += 1;
+}
+
+static void check_pair(TS_Pair pair, void *ctx)
+{
+    Stream_Check *check = ctx;
+    if (!check->same) return;
+
+    TS_Chunk chunk = check->reference->chunks[check->chunk - 1];
+    check->same = check->pairs < chunk.pairs_len && same_pair(chunk.pairs[check->pairs], pair);
+    check->pairs += 1;
+}
+
+// Streams unescape in place like ts_load2, so `source` is fed from a copy
+static _Bool stream_matches(TS_Load_Result *reference, char *source, ptrdiff_t source_len, ptrdiff_t feed)
+{
+    char *copy = malloc(source_len);
+    memcpy(copy, source, source_len);
+    source = copy;
+
+    Stream_Check check = { reference, 0, 0, 0, 1 };
+    TS_Stream_Callbacks callbacks = { check_heading, check_heading_pair, check_pair, &check };
+
+    TS_Stream stream = ts_stream_begin(callbacks, 0);
+    for (ptrdiff_t at = 0; at < source_len; at += feed)
+    {
+        ts_stream_feed(&stream, source + at, source_len - at < feed ? source_len - at : feed);
+    }
+    _Bool ok = ts_stream_end(&stream);
+
+    check_chunk_done(&check);
+    free(copy);
+    return ok && check.same && check.chunk == reference->chunks_len;
+}
+
+/* Corpora */
+
+// Mostly small sprites with a few properties each, wired up with signals
+static void corpus_mixed(Buffer *b, ptrdiff_t size)
+{
+    append(b, "[gd_scene load_steps=3 format=3 uid=\"uid://bench\"]\n\n");
+    append(b, "[ext_resource type=\"Texture2D\" path=\"res://enemy.png\" id=\"1_tex\"]\n\n");
+    append(b, "[node name=\"Level\" type=\"Node2D\"]\n\n");
+
+    for (int i = 0; b->len < size; i++)
+    {
+        append(b, "[node name=\"Enemy%d\" type=\"Sprite2D\" parent=\".\"]\n", i);
+        append(b, "position = Vector2(%d, %d)\n", i * 16, i * 8);
+        append(b, "texture = ExtResource(\"1_tex\")\n");
+        append(b, "editor_description = \"enemy \\\"number\\\" %d\"\n", i);
+        append(b, "metadata/path = [%d, 0.70710678118654757, {\"hp\": %d}]\n\n", i, i % 100);
+        if (i % 4 == 3)
+        {
+            append(b, "[connection signal=\"died\" from=\"Enemy%d\" to=\".\" method=\"_on_enemy_died\" flags=3]\n\n", i);
+        }
+    }
+}
+
+// Chains of nested nodes, so parent paths get long
+static void corpus_deep(Buffer *b, ptrdiff_t size)
+{
+    append(b, "[gd_scene format=3]\n\n[node name=\"World\" type=\"Node3D\"]\n\n");
+
+    Buffer path = {0};
+    for (int tree = 0; b->len < size; tree++)
+    {
+        path.len = 0;
+        append(&path, ".");
+        for (int depth = 0; depth < 48 && b->len < size; depth++)
+        {
+            append(b, "[node name=\"Bone%d_%d\" type=\"Node3D\" parent=\"%s\"]\n", tree, depth, path.data);
+            append(b, "transform = Transform3D(1, 0, 0, 0, 1, 0, 0, 0, 1, 0, %u.5, 0)\n\n", rng() % 10);
+
+            if (depth)
+            {
+                append(&path, "/Bone%d_%d", tree, depth);
+            }
+            else
+            {
+                path.len = 0;
+                append(&path, "Bone%d_0", tree);
+            }
+        }
+    }
+    free(path.data);
+}
+
+// A long resource list up front, nodes pick from it at random
+static void corpus_resources(Buffer *b, ptrdiff_t size)
+{
+    int resources = (int) (size / 1024) + 1;
+    append(b, "[gd_scene load_steps=%d format=3 uid=\"uid://resources\"]\n\n", resources + 1);
+    for (int i = 0; i < resources; i++)
+    {
+        append(b, "[ext_resource type=\"PackedScene\" uid=\"uid://r%x\" path=\"res://props/prop_%d.tscn\" id=\"%d_%x\"]\n",
+               rng(), i, i, i * 2654435761u);
+    }
+    append(b, "\n[sub_resource type=\"CircleShape2D\" id=\"CircleShape2D_1\"]\nradius = 12.0\n\n");
+    append(b, "[node name=\"Props\" type=\"Node2D\"]\n\n");
+
+    for (int i = 0; b->len < size; i++)
+    {
+        int r = (int) (rng() % resources);
+        append(b, "[node name=\"Prop%d\" parent=\".\" instance=ExtResource(\"%d_%x\")]\n", i, r, r * 2654435761u);
+        append(b, "position = Vector2(%u, %u)\n", rng() % 4096, rng() % 4096);
+        append(b, "shape = SubResource(\"CircleShape2D_1\")\n\n");
+    }
+}
+
+// Navigation polygons and tile maps, a few very long lines
+static void corpus_packed(Buffer *b, ptrdiff_t size)
+{
+    append(b, "[gd_scene format=3]\n\n");
+    for (int i = 0; b->len < size / 2; i++)
+    {
+        append(b, "[sub_resource type=\"NavigationPolygon\" id=\"NavigationPolygon_%d\"]\nvertices = PackedVector2Array(", i);
+        for (int v = 0; v < 2048; v++)
+        {
+            append(b, v ? ", %u.25, %u.75" : "%u.25, %u.75", rng() % 8192, rng() % 8192);
+        }
+        append(b, ")\n\n");
+    }
+
+    append(b, "[node name=\"Map\" type=\"Node2D\"]\n\n");
+    for (int i = 0; b->len < size; i++)
+    {
+        append(b, "[node name=\"Layer%d\" type=\"TileMap\" parent=\".\"]\nformat = 2\nlayer_0/tile_data = PackedInt32Array(", i);
+        for (int cell = 0; cell < 16384; cell++)
+        {
+            append(b, cell ? ", %d, %u, 0" : "%d, %u, 0", (cell % 128) | (cell / 128) << 16, 65536 * (rng() % 16));
+        }
+        append(b, ")\n\n");
+    }
+}
+
+// Dialogue text full of escapes, some of it spanning lines
+static void corpus_strings(Buffer *b, ptrdiff_t size)
+{
+    append(b, "[gd_scene format=3]\n\n[node name=\"Dialogue\" type=\"Control\"]\n\n");
+    for (int i = 0; b->len < size; i++)
+    {
+        append(b, "[node name=\"Line%d\" type=\"Label\" parent=\".\"]\ntext = \"", i);
+        int words = 20 + rng() % 200;
+        for (int w = 0; w < words; w++)
+        {
+            switch (rng() % 16)
+            {
+            case 0:  append(b, "\\\"quoted\\\" "); break;
+            case 1:  append(b, "C:\\\\saves\\\\slot "); break;
+            case 2:  append(b, "tab\\there "); break;
+            case 3:  append(b, "\n"); break;
+            default: append(b, "lorem ipsum "); break;
+            }
+        }
+        append(b, "\"\ntooltip_text = \"line %d\"\n\n", i);
+    }
+}
+
+/* Measurements */
+
+static int mismatches;
+
+// A negative `peak_bytes` means the operation allocates out of sight and it is left out
+static void report(char *corpus, ptrdiff_t bytes, char *op, double seconds, TS_Load_Result result,
+                   ptrdiff_t peak_bytes, int matches)
+{
+    seconds = seconds > 1e-9 ? seconds : 1e-9; // below timer resolution
+    printf("{\"corpus\":\"%s\",\"bytes\":%td,\"op\":\"%s\",\"seconds\":%.9f,\"mb_per_s\":%.2f,"
+           "\"chunks\":%td,\"pairs\":%td,\"nodes\":%td,\"nodes_per_s\":%.0f",
+           corpus, bytes, op, seconds, (double) bytes / (1024.0 * 1024.0) / seconds,
+           result.chunks_len, result.all_pairs_len, result.nodes_len, (double) result.nodes_len / seconds);
+    if (peak_bytes >= 0)
+    {
+        printf(",\"peak_bytes\":%td", peak_bytes);
+    }
+    if (matches >= 0)
+    {
+        printf(",\"matches_reference\":%s", matches ? "true" : "false");
+        mismatches += !matches;
+    }
+    printf("}\n");
+    fflush(stdout);
+}
+
+// Repeats until roughly a quarter second has passed and keeps the best run,
+// `untimed` runs before each `body` and is left out of the time
+#define MEASURE(best, untimed, body)                                 \
+    do {                                                             \
+        double _total = 0;                                           \
+        best = 1e30;                                                 \
+        for (int _run = 0; _run < 100 && (_run < 3 || _total < 0.25); _run++) { \
+            untimed;                                                 \
+            double _start = now_seconds();                           \
+            body;                                                    \
+            double _elapsed = now_seconds() - _start;                \
+            _total += _elapsed;                                      \
+            best = _elapsed < best ? _elapsed : best;                \
+        }                                                            \
+    } while (0)
+
+#define BENCH_CACHE_DIR "ts_bench_cache"
+
+// Where ts_load_cached keeps the cooked `source`, removing it forces a miss
+static void cache_path(char *path, int path_size, char *source, ptrdiff_t source_len, TS_Load_Flags flags)
+{
+    snprintf(path, path_size, "%s/%016llx-%u.tsc", BENCH_CACHE_DIR,
+             (unsigned long long) ts_source_hash(source, source_len), (unsigned) flags);
+}
+
+static void bench_corpus(char *name, Buffer corpus)
+{
+    // ts_load2 unescapes in place, so every load gets a fresh copy of the source,
+    // timings include the copy. It is the caller's and is left out of peak_bytes.
+    char *source    = malloc(corpus.len);
+    char *reference_source = malloc(corpus.len);
+    double best;
+
+    memcpy(reference_source, corpus.data, corpus.len);
+    Counting_Allocator counter = {0};
+    TS_Allocator allocator = counting_allocator(&counter);
+    TS_Load_Result reference = ts_load1(reference_source, corpus.len, &allocator);
+    assert(reference.ok);
+    ptrdiff_t peak = counter.peak;
+    ts_unload1(reference, &allocator);
+
+    TS_Load_Result result = {0};
+    MEASURE(best, ts_unload(result),
+                  memcpy(source, corpus.data, corpus.len);
+                  result = ts_load1(source, corpus.len, 0));
+    ts_unload(result);
+
+    memcpy(reference_source, corpus.data, corpus.len);
+    reference = ts_load2(reference_source, corpus.len, 0, TS_Load_Decode_Values);
+    report(name, corpus.len, "ts_load1", best, reference, peak, -1);
+
+    // Alternative loaders, each checked against the reference
+    counter = (Counting_Allocator) {0};
+    memcpy(source, corpus.data, corpus.len);
+    result = ts_load2(source, corpus.len, &allocator, TS_Load_Read_Only);
+    peak = counter.peak;
+    _Bool matches = same_scene(reference, result);
+    ts_unload1(result, &allocator);
+    result = (TS_Load_Result) {0};
+    MEASURE(best, ts_unload(result), result = ts_load2(corpus.data, corpus.len, 0, TS_Load_Read_Only));
+    ts_unload(result);
+    report(name, corpus.len, "ts_load2_read_only", best, reference, peak, matches);
+
+    counter = (Counting_Allocator) {0};
+    memcpy(source, corpus.data, corpus.len);
+    result = ts_load2(source, corpus.len, &allocator, TS_Load_Decode_Values);
+    peak = counter.peak;
+    matches = same_scene(reference, result);
+    ts_unload1(result, &allocator);
+    result = (TS_Load_Result) {0};
+    MEASURE(best, ts_unload(result),
+                  memcpy(source, corpus.data, corpus.len);
+                  result = ts_load2(source, corpus.len, 0, TS_Load_Decode_Values));
+    ts_unload(result);
+    report(name, corpus.len, "ts_load2_decode", best, reference, peak, matches);
+
+    // Warm loader, the first load sizes it and the peak is counted from there
+    counter = (Counting_Allocator) {0};
+    TS_Loader loader;
+    ts_loader_init(&loader, &allocator);
+    memcpy(source, corpus.data, corpus.len);
+    result  = ts_loader_load(&loader, source, corpus.len, 0);
+    matches = same_scene(reference, result);
+    ts_loader_reset(&loader);
+    counter.peak = counter.live;
+    MEASURE(best, ts_loader_reset(&loader),
+                  memcpy(source, corpus.data, corpus.len);
+                  result = ts_loader_load(&loader, source, corpus.len, 0));
+    report(name, corpus.len, "ts_loader_load", best, reference, counter.peak, matches);
+    ts_loader_free(&loader);
+
+    // The cache and the file loader allocate with the stdlib, so no peak. The
+    // miss writes the cooked file the hit then maps.
+    char path[4096];
+    cache_path(path, sizeof(path), corpus.data, corpus.len, TS_Load_Decode_Values);
+    remove(path);
+    memcpy(source, corpus.data, corpus.len);
+    result  = ts_load_cached(source, corpus.len, BENCH_CACHE_DIR, TS_Load_Decode_Values);
+    matches = same_scene(reference, result);
+    MEASURE(best, ts_unload(result); remove(path),
+                  memcpy(source, corpus.data, corpus.len);
+                  result = ts_load_cached(source, corpus.len, BENCH_CACHE_DIR, TS_Load_Decode_Values));
+    report(name, corpus.len, "ts_load_cached_miss", best, reference, -1, matches);
+
+    ts_unload(result);
+    memcpy(source, corpus.data, corpus.len);
+    result  = ts_load_cached(source, corpus.len, BENCH_CACHE_DIR, TS_Load_Decode_Values);
+    matches = result.mapping != 0 && same_scene(reference, result);
+    MEASURE(best, ts_unload(result),
+                  memcpy(source, corpus.data, corpus.len);
+                  result = ts_load_cached(source, corpus.len, BENCH_CACHE_DIR, TS_Load_Decode_Values));
+    ts_unload(result);
+    report(name, corpus.len, "ts_load_cached_hit", best, reference, -1, matches);
+    remove(path);
+
+    // ts_load_file maps the scene itself, so it goes through a file too
+    snprintf(path, sizeof(path), "%s/bench.tscn", BENCH_CACHE_DIR);
+    FILE *file = fopen(path, "wb");
+    assert(file && fwrite(corpus.data, 1, corpus.len, file) == (size_t) corpus.len && !fclose(file));
+    result  = ts_load_file(path, 0);
+    matches = same_scene(reference, result);
+    MEASURE(best, ts_unload(result), result = ts_load_file(path, 0));
+    ts_unload(result);
+    report(name, corpus.len, "ts_load_file", best, reference, -1, matches);
+    remove(path);
+    remove(BENCH_CACHE_DIR); // empty by now
+
+    // Streams keep no result, only the line buffer counts
+    counter = (Counting_Allocator) {0};
+    matches = stream_matches(&reference, corpus.data, corpus.len, 4093) &&
+              stream_matches(&reference, corpus.data, corpus.len, TS_STREAM_READ_SIZE);
+    MEASURE(best, (void) 0,
+        memcpy(source, corpus.data, corpus.len);
+        TS_Stream stream = ts_stream_begin((TS_Stream_Callbacks) {0}, &allocator);
+        for (ptrdiff_t at = 0; at < corpus.len; at += TS_STREAM_READ_SIZE)
+        {
+            ptrdiff_t len = corpus.len - at < TS_STREAM_READ_SIZE ? corpus.len - at : TS_STREAM_READ_SIZE;
+            ts_stream_feed(&stream, source + at, len);
+        }
+        ts_stream_end(&stream));
+    report(name, corpus.len, "ts_stream_feed", best, reference, counter.peak, matches);
+
+    // An unedited scene saves back byte for byte and loads into the same scene
+    counter = (Counting_Allocator) {0};
+    TS_Save_Result saved = ts_save1(reference.chunks, reference.chunks_len, &allocator);
+    assert(saved.ok);
+    peak = counter.peak;
+    matches = same_slice(saved.output, saved.output_len, corpus.data, corpus.len);
+    TS_Load_Result reloaded = ts_load1(saved.output, saved.output_len, 0);
+    matches &= same_scene(reference, reloaded);
+    ts_unload(reloaded);
+    allocator.free(saved.output, allocator.ctx);
+    saved = (TS_Save_Result) {0};
+    MEASURE(best, free(saved.output), saved = ts_save1(reference.chunks, reference.chunks_len, 0));
+    assert(saved.ok);
+    report(name, saved.output_len, "ts_save1", best, reference, peak, matches);
+    free(saved.output);
+
+    ts_unload(reference);
+    free(reference_source);
+    free(source);
+}
+
+// A TileMap layer's tile_data, three ints per cell
+static void bench_packed(ptrdiff_t size)
+{
+    Buffer value = {0};
+    append(&value, "PackedInt32Array(");
+    for (int i = 0; value.len < size; i++)
+    {
+        append(&value, i ? ", %d, %d, %d" : "%d, %d, %d", (i % 256) | (i / 256) << 16, 65536 * (i % 7), i % 4);
+    }
+    append(&value, ")");
+
+    TS_Packed_Info info = ts_packed_info(value.data, value.len);
+    assert(info.ok);
+    int32_t *cells = malloc(info.size);
+
+    double best;
+    _Bool ok = 1;
+    MEASURE(best, (void) 0, ok &= ts_decode_packed(value.data, value.len, cells, info.size));
+    assert(ok);
+    printf("{\"op\":\"ts_decode_packed\",\"bytes\":%td,\"seconds\":%.9f,\"mb_per_s\":%.2f,\"elements_per_s\":%.0f}\n",
+           value.len, best, (double) value.len / (1024.0 * 1024.0) / best, (double) info.len / best);
+
+    free(cells);
+    free(value.data);
+}
+
+// Loads each file every way there is and compares against ts_load1
+static int check_files(char **paths, int paths_len)
+{
+    for (int i = 0; i < paths_len; i++)
+    {
+        FILE *file = fopen(paths[i], "rb");
+        if (!file)
+        {
+            printf("{\"file\":\"%s\",\"error\":\"cannot open\"}\n", paths[i]);
+            mismatches += 1;
+            continue;
+        }
+
+        Buffer source = {0};
+        char chunk[1 << 16];
+        for (size_t read; (read = fread(chunk, 1, sizeof(chunk), file)) > 0;)
+        {
+            append(&source, "%.*s", (int) read, chunk);
+        }
+        fclose(file);
+
+        bench_corpus(paths[i], source);
+        free(source.data);
+    }
+    return mismatches != 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && !strcmp(argv[1], "--check"))
+    {
+        return check_files(argv + 2, argc - 2);
+    }
+
+    ptrdiff_t max_bytes = argc > 1 ? strtoll(argv[1], 0, 10) : 16 << 20;
+    ptrdiff_t sizes[] = { 10 << 10, 1 << 20, 16 << 20, 128 << 20, 500 << 20 };
+
+    struct {
+        char *name;
+        void (*generate)(Buffer *, ptrdiff_t);
+    } corpora[] = {
+        { "mixed",     corpus_mixed },
+        { "deep",      corpus_deep },
+        { "resources", corpus_resources },
+        { "packed",    corpus_packed },
+        { "strings",   corpus_strings },
+    };
+
+    for (int c = 0; c < (int) (sizeof(corpora) / sizeof(corpora[0])); c++)
+    {
+        for (int s = 0; s < (int) (sizeof(sizes) / sizeof(sizes[0])) && sizes[s] <= max_bytes; s++)
+        {
+            Buffer corpus = {0};
+            rng_state = 0x9e3779b97f4a7c15;
+            corpora[c].generate(&corpus, sizes[s]);
+            bench_corpus(corpora[c].name, corpus);
+            free(corpus.data);
+        }
+    }
+
+    for (int s = 0; s < (int) (sizeof(sizes) / sizeof(sizes[0])) && sizes[s] <= max_bytes; s++)
+    {
+        bench_packed(sizes[s]);
+    }
+    return mismatches != 0;
+}
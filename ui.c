@@ -5,9 +5,9 @@ typedef struct
 } Str;
 #define S(s) (Str) {s, sizeof(s) - 1}
 
-uint64_t hash64(Str s)
+uint64_t hash64_seed(uint64_t seed, Str s)
 {
-    uint64_t h = 0x100;
+    uint64_t h = seed;
     for (ptrdiff_t i = 0; i < s.len; i++) {
         h ^= s.data[i] & 255;
         h *= 1111111111111111111;
@@ -15,6 +15,11 @@ uint64_t hash64(Str s)
     return h;
 }
 
+uint64_t hash64(Str s)
+{
+    return hash64_seed(0x100, s);
+}
+
 _Bool equals(Str a, Str b)
 {
     if (a.len != b.len) {
@@ -144,14 +149,48 @@ RectCut cut_side(RectCut rect, float a)
 
 typedef enum
 {
-    UI_BoxFlag_Clickable,
-    UI_BoxFlag_DrawBorder,
-    UI_BoxFlag_DrawText,
-    UI_BoxFlag_DrawBackground,
-    UI_BoxFlag_AnimationHot,
-    UI_BoxFlag_AnimationActive,
+    UI_BoxFlag_Clickable       = 1 << 0,
+    UI_BoxFlag_DrawBorder      = 1 << 1,
+    UI_BoxFlag_DrawText        = 1 << 2,
+    UI_BoxFlag_DrawBackground  = 1 << 3,
+    UI_BoxFlag_AnimationHot    = 1 << 4,
+    UI_BoxFlag_AnimationActive = 1 << 5,
+    UI_BoxFlag_FloatingX       = 1 << 6, // placed at position.x, left out of the parent's layout
+    UI_BoxFlag_FloatingY       = 1 << 7,
 } UI_BoxFlag;
 
+typedef enum
+{
+    UI_Axis_X,
+    UI_Axis_Y,
+    UI_Axis_COUNT,
+} UI_Axis;
+
+typedef enum
+{
+    UI_SizeKind_Null,
+    UI_SizeKind_Pixels,          // value pixels
+    UI_SizeKind_TextContent,     // the string's extent plus value pixels on each side
+    UI_SizeKind_PercentOfParent, // value is a fraction of the parent
+    UI_SizeKind_ChildrenSum,     // children summed on the layout axis, the largest on the other
+} UI_SizeKind;
+
+// strictness is how much of the size must survive when children overflow their
+// parent, 1 never shrinks and 0 gives everything up
+typedef struct
+{
+    UI_SizeKind kind;
+    float value;
+    float strictness;
+} UI_Size;
+
+#define UI_Px(v, s)          ((UI_Size) {UI_SizeKind_Pixels, (v), (s)})
+#define UI_TextDim(pad, s)   ((UI_Size) {UI_SizeKind_TextContent, (pad), (s)})
+#define UI_Pct(v, s)         ((UI_Size) {UI_SizeKind_PercentOfParent, (v), (s)})
+#define UI_ChildrenSum(s)    ((UI_Size) {UI_SizeKind_ChildrenSum, 0, (s)})
+
+#define UI_TEXT_SIZE 20
+
 typedef struct UI_Box UI_Box;
 struct UI_Box
 {
@@ -168,14 +207,19 @@ struct UI_Box
     Str string;
 
     // initialize by builder code, but can be modified.
-    Vector2 size;
-    Vector2 position;
+    UI_Size semantic_size[UI_Axis_COUNT];
+    UI_Axis child_layout_axis;
+    Vector2 position; // of floating boxes, relative to the parent
 
     // computed every frame
+    float computed_size[UI_Axis_COUNT];
+    float computed_position[UI_Axis_COUNT]; // relative to the parent
     Rectangle rect;
 
     // generation info
-    int64_t key;
+    uint64_t key;
+    uint64_t first_touched_frame;
+    uint64_t last_touched_frame;
 
     // persistent data
     float hot;
@@ -196,24 +240,34 @@ typedef struct
     _Bool hovering;
 } UI_Comm;
 
-typedef struct UI_Map UI_Map;
-struct UI_Map
-{
-    UI_Map *child[4];
-    Str key;
-    UI_Box *value;
-};
-
 typedef struct UI_ParentNode UI_ParentNode;
 struct UI_ParentNode {
     UI_ParentNode *next;
     UI_Box *value;
 };
 
+typedef struct UI_IdNode UI_IdNode;
+struct UI_IdNode {
+    UI_IdNode *next;
+    uint64_t value;
+};
+
+#define UI_BOX_TABLE_MIN 256
+
 typedef struct
 {
-    Arena arena;
-    UI_Map *map;
+    Arena arena; // persistent, boxes and the box table
+
+    // Open addressed on key with linear probing, at most half full. Outgrown
+    // tables stay in the arena, together they are smaller than the current one.
+    UI_Box **box_table;
+    ptrdiff_t box_table_cap;
+
+    // Reset in UI_BeginBuild. The halves alternate, so what the last frame
+    // put there is still readable while the next one handles input.
+    Arena *frame_arena;
+    Arena frame_arenas[2];
+    char *frame_bases[2];
 
     UI_Box *root;
     struct {
@@ -221,9 +275,24 @@ typedef struct
         UI_ParentNode *free;
     } parent_stack;
     UI_ParentNode parent_nil_stack_top;
+    struct {
+        UI_IdNode *top;
+        UI_IdNode *free;
+    } id_stack;
 
     Vector2 starting_origin;
     Font font;
+
+    // Pre-order boxes of the last UI_Solve, in frame memory. UI_Render draws these.
+    UI_Box **order;
+    ptrdiff_t order_len;
+
+    // Boxes live until a frame goes by without building them, then they
+    // wait on the free list for the next new key
+    uint64_t frame_index;
+    ptrdiff_t box_count;
+    ptrdiff_t boxes_touched; // this frame
+    UI_Box *free_boxes;
 } UI_State;
 
 UI_State ui_state = {0};
@@ -262,57 +331,236 @@ void UI_InitGlobals(void) {
 }
 #endif
 
+// Half of `frame` goes to each frame arena
+void UI_InitArenas(Arena persistent, Arena frame)
+{
+    ptrdiff_t half = (frame.end - frame.beg) / 2;
+    ui_state.arena = persistent;
+    ui_state.frame_bases[0] = frame.beg;
+    ui_state.frame_bases[1] = frame.beg + half;
+    ui_state.frame_arenas[0] = (Arena) {frame.beg, frame.beg + half};
+    ui_state.frame_arenas[1] = (Arena) {frame.beg + half, frame.end};
+    ui_state.frame_arena = &ui_state.frame_arenas[0];
+}
+
+// Copies into the frame arena, zero terminated for raylib's text functions
+Str UI_PushStr(Str s)
+{
+    char *data = new(ui_state.frame_arena, s.len + 1, char);
+    if (s.len)
+    {
+        memcpy(data, s.data, s.len);
+    }
+    return (Str) {data, s.len};
+}
+
+Str UI_PushStrF(char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(0, 0, format, args);
+    va_end(args);
+
+    char *data = new(ui_state.frame_arena, len + 1, char);
+    va_start(args, format);
+    vsnprintf(data, len + 1, format, args);
+    va_end(args);
+    return (Str) {data, len};
+}
+
 _Bool UI_BoxIsNil(UI_Box *b) {
     return b == &ui_g_nil_box;
 }
 
 #define UI_BoxSetNil(b) ((b) = &ui_g_nil_box)
 
-UI_Box **UI_Lookup(UI_Map **map, Str key, Arena *a)
+void UI_TableInsert(UI_Box *box)
 {
-    uint64_t h = hash64(key);
-    while (*map)
+    ptrdiff_t mask = ui_state.box_table_cap - 1;
+    ptrdiff_t slot = (ptrdiff_t)(box->key & mask);
+    while (ui_state.box_table[slot])
     {
-        if (equals(key, (*map)->key))
+        slot = (slot + 1) & mask;
+    }
+    ui_state.box_table[slot] = box;
+}
+
+// Shifts the rest of the probe run back over the hole, so no tombstones
+void UI_TableRemove(ptrdiff_t slot)
+{
+    ptrdiff_t mask = ui_state.box_table_cap - 1;
+    for (ptrdiff_t next = (slot + 1) & mask; ui_state.box_table[next]; next = (next + 1) & mask)
+    {
+        ptrdiff_t home = (ptrdiff_t)(ui_state.box_table[next]->key & mask);
+        if (((next - home) & mask) >= ((next - slot) & mask))
         {
-            return &(*map)->value;
+            ui_state.box_table[slot] = ui_state.box_table[next];
+            slot = next;
         }
-        map = &(*map)->child[h >> 62];
-        h <<= 2;
     }
+    ui_state.box_table[slot] = 0;
+}
 
-    *map = new(a, 1, UI_Map);
-    (*map)->key = key;
-    // (*map)->value = &ui_g_nil_box;
-    (*map)->value = new(&ui_state.arena, 1, UI_Box);
-    (*map)->value->first  = &ui_g_nil_box;
-    (*map)->value->last   = &ui_g_nil_box;
-    (*map)->value->next   = &ui_g_nil_box;
-    (*map)->value->prev   = &ui_g_nil_box;
-    (*map)->value->parent = &ui_g_nil_box;
-    return &(*map)->value;
+UI_Box *UI_Lookup(uint64_t key)
+{
+    if (ui_state.box_table_cap)
+    {
+        ptrdiff_t mask = ui_state.box_table_cap - 1;
+        for (ptrdiff_t slot = (ptrdiff_t)(key & mask); ui_state.box_table[slot]; slot = (slot + 1) & mask)
+        {
+            if (ui_state.box_table[slot]->key == key)
+            {
+                return ui_state.box_table[slot];
+            }
+        }
+    }
+
+    if ((ui_state.box_count + 1) * 2 > ui_state.box_table_cap)
+    {
+        ptrdiff_t old_cap = ui_state.box_table_cap;
+        UI_Box **old = ui_state.box_table;
+        ui_state.box_table_cap = old_cap ? old_cap * 2 : UI_BOX_TABLE_MIN;
+        ui_state.box_table = new(&ui_state.arena, ui_state.box_table_cap, UI_Box *);
+        for (ptrdiff_t i = 0; i < old_cap; i++)
+        {
+            if (old[i]) UI_TableInsert(old[i]);
+        }
+    }
+
+    UI_Box *box = ui_state.free_boxes;
+    if (box)
+    {
+        ui_state.free_boxes = box->next;
+        memset(box, 0, sizeof(*box));
+    }
+    else
+    {
+        box = new(&ui_state.arena, 1, UI_Box);
+    }
+
+    box->first  = &ui_g_nil_box;
+    box->last   = &ui_g_nil_box;
+    box->next   = &ui_g_nil_box;
+    box->prev   = &ui_g_nil_box;
+    box->parent = &ui_g_nil_box;
+    box->key    = key;
+    box->first_touched_frame = ui_state.frame_index;
+    box->last_touched_frame  = ui_state.frame_index - 1;
+
+    UI_TableInsert(box);
+    ui_state.box_count += 1;
+    return box;
+}
+
+// Frees every box the current frame didn't build. A removal can pull a later
+// entry back into its slot, so the slot is checked again.
+void UI_Prune(void)
+{
+    if (ui_state.boxes_touched == ui_state.box_count)
+    {
+        return;
+    }
+
+    for (ptrdiff_t slot = 0; slot < ui_state.box_table_cap;)
+    {
+        UI_Box *box = ui_state.box_table[slot];
+        if (box && box->last_touched_frame != ui_state.frame_index)
+        {
+            box->next = ui_state.free_boxes;
+            ui_state.free_boxes = box;
+            ui_state.box_count -= 1;
+            UI_TableRemove(slot);
+        }
+        else
+        {
+            slot += 1;
+        }
+    }
+}
+
+void UI_PushID(Str id)
+{
+    UI_IdNode *node = ui_state.id_stack.free;
+    if (node)
+    {
+        ui_state.id_stack.free = node->next;
+    }
+    else
+    {
+        node = new(ui_state.frame_arena, 1, UI_IdNode);
+    }
+
+    node->value = hash64_seed(ui_state.id_stack.top ? ui_state.id_stack.top->value : 0x100, id);
+    node->next = ui_state.id_stack.top;
+    ui_state.id_stack.top = node;
+}
+
+void UI_PopID(void)
+{
+    UI_IdNode *popped = ui_state.id_stack.top;
+    if (popped)
+    {
+        ui_state.id_stack.top = popped->next;
+        popped->next = ui_state.id_stack.free;
+        ui_state.id_stack.free = popped;
+    }
+}
+
+// "label##id" shows "label" and keys on the whole string, so equal labels can
+// be told apart. Keys also take in the parent's key and the ID stack, so the
+// same label under two panels is two boxes.
+uint64_t UI_KeyFromString(Str string, UI_Box *parent)
+{
+    uint64_t seed = ui_state.id_stack.top ? ui_state.id_stack.top->value : 0x100;
+    return hash64_seed(seed ^ parent->key * 1111111111111111111, string);
+}
+
+Str UI_DisplayString(Str string)
+{
+    for (ptrdiff_t i = 0; i + 1 < string.len; i++)
+    {
+        if (string.data[i] == '#' && string.data[i + 1] == '#')
+        {
+            string.len = i;
+            break;
+        }
+    }
+    return string;
 }
 
 UI_Box *UI_BoxMake(UI_BoxFlag flags, Str string)
 {
-    UI_Box **slot = UI_Lookup(&ui_state.map, string, &ui_state.arena);
-    UI_Box *box = *slot;
+    UI_Box *parent = ui_state.parent_stack.top->value;
+    UI_Box *box = UI_Lookup(UI_KeyFromString(string, parent));
+
+    // Links are rebuilt every frame, only the persistent data carries over
+    if (box->last_touched_frame != ui_state.frame_index)
+    {
+        box->last_touched_frame = ui_state.frame_index;
+        ui_state.boxes_touched += 1;
+
+        UI_BoxSetNil(box->first);
+        UI_BoxSetNil(box->last);
+        UI_BoxSetNil(box->next);
+        UI_BoxSetNil(box->prev);
+        UI_BoxSetNil(box->parent);
+        box->child_count = 0;
+    }
 
     box->flags = flags;
 
     if (flags & UI_BoxFlag_DrawText)
     {
-        box->string = string;
+        box->string = UI_PushStr(UI_DisplayString(string));
     }
 
-    box->size = (Vector2) {100, 100};
+    // The rect stays the last frame's until UI_Solve, input is checked against it
+    _Bool text = (flags & UI_BoxFlag_DrawText) != 0;
+    box->semantic_size[UI_Axis_X] = text ? UI_TextDim(8, 1) : UI_ChildrenSum(1);
+    box->semantic_size[UI_Axis_Y] = text ? UI_TextDim(4, 1) : UI_ChildrenSum(1);
+    box->child_layout_axis = UI_Axis_Y;
     box->position = ui_state.starting_origin;
-    box->rect.x = box->position.x;
-    box->rect.y = box->position.y;
-    box->rect.width = box->size.x;
-    box->rect.height = box->size.y;
-    
-    UI_Box *parent = ui_state.parent_stack.top->value;
+
     if (UI_BoxIsNil(parent)) // Parent stuff
     {
         ui_state.root = box;
@@ -324,7 +572,6 @@ UI_Box *UI_BoxMake(UI_BoxFlag flags, Str string)
             // List is empty
             parent->first = box;
             parent->last = box;
-            parent->next = box;
             UI_BoxSetNil(box->next);
             UI_BoxSetNil(box->prev);
         } else if (UI_BoxIsNil(parent->last)) {
@@ -384,17 +631,14 @@ _Bool UI_Button(Str text)
 UI_Box *UI_Panel(int x, int y, int w, int h, Str text)
 {
     UI_Box *box = UI_BoxMake(UI_BoxFlag_DrawBorder |
-                             UI_BoxFlag_DrawBackground
+                             UI_BoxFlag_DrawBackground |
+                             UI_BoxFlag_FloatingX |
+                             UI_BoxFlag_FloatingY
                              , text);
     box->position.x = x;
     box->position.y = y;
-    box->size.x = w;
-    box->size.y = h;
-
-    box->rect.x = box->position.x;
-    box->rect.y = box->position.y;
-    box->rect.width = box->size.x;
-    box->rect.height = box->size.y;
+    box->semantic_size[UI_Axis_X] = UI_Px(w, 1);
+    box->semantic_size[UI_Axis_Y] = UI_Px(h, 1);
     return box;
 }
 
@@ -410,7 +654,7 @@ UI_Box *UI_PushParent(UI_Box *box)
     }
     else
     {
-        node = new(&ui_state.arena, 1, UI_ParentNode);
+        node = new(ui_state.frame_arena, 1, UI_ParentNode);
     }
 
     UI_Box *old_value = ui_state.parent_stack.top->value;
@@ -429,14 +673,11 @@ UI_Box *UI_PopParent(void)
     if (popped != &ui_state.parent_nil_stack_top)
     {
         // StackPop(ui_state->parent_stack.top);
-        if (ui_state.parent_stack.top)
-        {
-            ui_state.parent_stack.top = ui_state.parent_stack.top->next;
-        }
+        ui_state.parent_stack.top = popped->next;
 
         // StackPush(ui_state->parent_stack.free, popped);
         popped->next = ui_state.parent_stack.free;
-        ui_state.parent_stack.top = popped;
+        ui_state.parent_stack.free = popped;
     }
 
     return popped->value;
@@ -444,6 +685,7 @@ UI_Box *UI_PopParent(void)
 
 #define DeferLoop(begin, end) for(int _i_ = ((begin), 0); !_i_; _i_ += 1, (end))
 #define UI_Parent(v) DeferLoop(UI_PushParent(v), UI_PopParent())
+#define UI_ID(id) DeferLoop(UI_PushID(id), UI_PopID())
 
 void UI_RenderBox(UI_Box *box)
 {
@@ -472,7 +714,7 @@ void UI_RenderBox(UI_Box *box)
     if (box->flags & UI_BoxFlag_DrawText)
     {
         const char *text = box->string.data;
-        int fontSize = 20;
+        int fontSize = UI_TEXT_SIZE;
         Vector2 textSize = MeasureTextEx(ui_state.font, text, fontSize, 1.0f);
         Vector2 textPos = {
             box->rect.x + (box->rect.width - textSize.x) / 2,
@@ -484,58 +726,281 @@ void UI_RenderBox(UI_Box *box)
 
 void UI_BeginBuild(int win_x, int win_y, float dt)
 {
+    UI_Prune();
+    ui_state.frame_index += 1;
+    ui_state.boxes_touched = 0;
+
+    ptrdiff_t half = ui_state.frame_index & 1;
+    ui_state.frame_arena = &ui_state.frame_arenas[half];
+    ui_state.frame_arena->beg = ui_state.frame_bases[half];
+
+    // Stack nodes lived in frame memory
+    UI_BoxSetNil(ui_state.root);
     ui_state.parent_stack.top = &ui_state.parent_nil_stack_top;
     ui_state.parent_stack.free = 0;
+    ui_state.id_stack.top = 0;
+    ui_state.id_stack.free = 0;
+    ui_state.order_len = 0;
+
+    // Everything built this frame goes under a box the size of the window
+    UI_Box *root = UI_BoxMake(0, S("##window"));
+    root->semantic_size[UI_Axis_X] = UI_Px(win_x, 1);
+    root->semantic_size[UI_Axis_Y] = UI_Px(win_y, 1);
+    UI_PushParent(root);
 }
 
+void UI_Solve(UI_Box *root);
+
 void UI_EndBuild()
 {
+    UI_PopParent();
+    UI_Solve(ui_state.root);
+}
+
+float UI_AxisOf(Vector2 v, UI_Axis axis)
+{
+    return axis == UI_Axis_X ? v.x : v.y;
 }
 
-void UI_Solve(UI_Box *box)
+// Pre-order without recursion, climbing through parent links. Stops early if
+// a key was built twice in one frame and the links loop.
+ptrdiff_t UI_Flatten(UI_Box *root, UI_Box **order, ptrdiff_t cap)
 {
-    if (UI_BoxIsNil(box->parent))
+    ptrdiff_t len = 0;
+    for (UI_Box *box = root; !UI_BoxIsNil(box) && len < cap;)
     {
-        box->rect.x = box->position.x;
-        box->rect.y = box->position.y;
+        order[len++] = box;
+        if (!UI_BoxIsNil(box->first))
+        {
+            box = box->first;
+            continue;
+        }
+        while (box != root && UI_BoxIsNil(box->next))
+        {
+            box = box->parent;
+        }
+        box = box == root ? &ui_g_nil_box : box->next;
     }
-    else
+    return len;
+}
+
+// Sizes that need nothing else: pixels and text. Both axes at once, so text
+// is measured once per box.
+void UI_SolveStandalone(UI_Box **order, ptrdiff_t len)
+{
+    for (ptrdiff_t i = 0; i < len; i++)
     {
-        box->rect.x = box->parent->rect.x + box->position.x;
-        box->rect.y = box->parent->rect.y + box->position.y;
+        UI_Box *box = order[i];
+        Vector2 text = {0};
+        if (box->string.data &&
+            (box->semantic_size[UI_Axis_X].kind == UI_SizeKind_TextContent ||
+             box->semantic_size[UI_Axis_Y].kind == UI_SizeKind_TextContent))
+        {
+            text = MeasureTextEx(ui_state.font, box->string.data, UI_TEXT_SIZE, 1.0f);
+        }
+
+        for (UI_Axis axis = 0; axis < UI_Axis_COUNT; axis++)
+        {
+            UI_Size size = box->semantic_size[axis];
+            switch (size.kind)
+            {
+                case UI_SizeKind_Pixels:
+                    box->computed_size[axis] = size.value;
+                    break;
+                case UI_SizeKind_TextContent:
+                    box->computed_size[axis] = UI_AxisOf(text, axis) + 2*size.value;
+                    break;
+                default:
+                    box->computed_size[axis] = 0;
+                    break;
+            }
+        }
     }
+}
 
-    box->rect.width  = box->size.x;
-    box->rect.height = box->size.y;
+// Percent of parent, parents come first. A parent sized by its children isn't
+// known yet, so the fraction is of the nearest ancestor that is.
+void UI_SolveUpwards(UI_Box **order, ptrdiff_t len, UI_Axis axis)
+{
+    for (ptrdiff_t i = 0; i < len; i++)
+    {
+        UI_Box *box = order[i];
+        if (box->semantic_size[axis].kind != UI_SizeKind_PercentOfParent)
+        {
+            continue;
+        }
 
-    for (UI_Box *child = box->first; !UI_BoxIsNil(child); child = child->next)
+        UI_Box *sizer = box->parent;
+        while (!UI_BoxIsNil(sizer) && sizer->semantic_size[axis].kind == UI_SizeKind_ChildrenSum)
+        {
+            sizer = sizer->parent;
+        }
+        box->computed_size[axis] = UI_BoxIsNil(sizer) ? 0 : sizer->computed_size[axis] * box->semantic_size[axis].value;
+    }
+}
+
+// Children sums, walking backwards so children are done before their parent
+void UI_SolveDownwards(UI_Box **order, ptrdiff_t len, UI_Axis axis)
+{
+    UI_BoxFlag floating = axis == UI_Axis_X ? UI_BoxFlag_FloatingX : UI_BoxFlag_FloatingY;
+    for (ptrdiff_t i = len - 1; i >= 0; i--)
     {
-        UI_Solve(child);
+        UI_Box *box = order[i];
+        if (box->semantic_size[axis].kind != UI_SizeKind_ChildrenSum)
+        {
+            continue;
+        }
+
+        float sum = 0;
+        for (UI_Box *child = box->first; !UI_BoxIsNil(child); child = child->next)
+        {
+            if (child->flags & floating)
+            {
+                continue;
+            }
+            float size = child->computed_size[axis];
+            sum = axis == box->child_layout_axis ? sum + size : (size > sum ? size : sum);
+        }
+        box->computed_size[axis] = sum;
     }
 }
 
+// Children that don't fit give up what their strictness allows, in proportion
+void UI_SolveViolations(UI_Box **order, ptrdiff_t len, UI_Axis axis)
+{
+    UI_BoxFlag floating = axis == UI_Axis_X ? UI_BoxFlag_FloatingX : UI_BoxFlag_FloatingY;
+    for (ptrdiff_t i = 0; i < len; i++)
+    {
+        UI_Box *box = order[i];
+        float available = box->computed_size[axis];
+
+        if (axis != box->child_layout_axis)
+        {
+            for (UI_Box *child = box->first; !UI_BoxIsNil(child); child = child->next)
+            {
+                float excess = child->computed_size[axis] - available;
+                float slack  = child->computed_size[axis] * (1 - child->semantic_size[axis].strictness);
+                if (!(child->flags & floating) && excess > 0)
+                {
+                    child->computed_size[axis] -= excess < slack ? excess : slack;
+                }
+            }
+            continue;
+        }
+
+        float total = 0;
+        float slack = 0;
+        for (UI_Box *child = box->first; !UI_BoxIsNil(child); child = child->next)
+        {
+            if (!(child->flags & floating))
+            {
+                total += child->computed_size[axis];
+                slack += child->computed_size[axis] * (1 - child->semantic_size[axis].strictness);
+            }
+        }
+
+        float excess = total - available;
+        if (excess > 0 && slack > 0)
+        {
+            float fraction = excess < slack ? excess / slack : 1;
+            for (UI_Box *child = box->first; !UI_BoxIsNil(child); child = child->next)
+            {
+                if (!(child->flags & floating))
+                {
+                    child->computed_size[axis] -= fraction * child->computed_size[axis] * (1 - child->semantic_size[axis].strictness);
+                }
+            }
+        }
+    }
+}
+
+// Children stack along the layout axis, floating ones sit at their position
+void UI_SolvePositions(UI_Box **order, ptrdiff_t len, UI_Axis axis)
+{
+    UI_BoxFlag floating = axis == UI_Axis_X ? UI_BoxFlag_FloatingX : UI_BoxFlag_FloatingY;
+    for (ptrdiff_t i = 0; i < len; i++)
+    {
+        UI_Box *box = order[i];
+        float origin = i ? (axis == UI_Axis_X ? box->parent->rect.x : box->parent->rect.y) : 0;
+        if (i == 0)
+        {
+            box->computed_position[axis] = UI_AxisOf(box->position, axis);
+        }
+
+        float cursor = 0;
+        for (UI_Box *child = box->first; !UI_BoxIsNil(child); child = child->next)
+        {
+            if (child->flags & floating)
+            {
+                child->computed_position[axis] = UI_AxisOf(child->position, axis);
+            }
+            else if (axis == box->child_layout_axis)
+            {
+                child->computed_position[axis] = cursor;
+                cursor += child->computed_size[axis];
+            }
+            else
+            {
+                child->computed_position[axis] = 0;
+            }
+        }
+
+        if (axis == UI_Axis_X)
+        {
+            box->rect.x = origin + box->computed_position[axis];
+            box->rect.width = box->computed_size[axis];
+        }
+        else
+        {
+            box->rect.y = origin + box->computed_position[axis];
+            box->rect.height = box->computed_size[axis];
+        }
+    }
+}
+
+// Lays out `root` and everything under it, one linear pass per step and axis,
+// except the standalone sizes which take both axes in one
+void UI_Solve(UI_Box *root)
+{
+    ui_state.order = new(ui_state.frame_arena, ui_state.box_count, UI_Box *);
+    ui_state.order_len = UI_Flatten(root, ui_state.order, ui_state.box_count);
+
+    UI_SolveStandalone(ui_state.order, ui_state.order_len);
+    for (UI_Axis axis = 0; axis < UI_Axis_COUNT; axis++)
+    {
+        UI_SolveUpwards(ui_state.order, ui_state.order_len, axis);
+        UI_SolveDownwards(ui_state.order, ui_state.order_len, axis);
+        UI_SolveViolations(ui_state.order, ui_state.order_len, axis);
+        UI_SolvePositions(ui_state.order, ui_state.order_len, axis);
+    }
+}
+
+// Parents draw before their children
 void UI_Render()
 {
-    for (UI_Box *child = ui_state.root; !UI_BoxIsNil(child); child = child->next)
+    for (ptrdiff_t i = 0; i < ui_state.order_len; i++)
     {
-        UI_RenderBox(child);
+        UI_RenderBox(ui_state.order[i]);
     }
-    ui_state.root = 0;
+    ui_state.order_len = 0;
 }
 
 #ifdef ENGINE_UNIT
 int main(void)
 {
     InitWindow(480, 270, "UI Demo");
-    ui_state.parent_nil_stack_top.value = &ui_g_nil_box;
-    ui_state.parent_nil_stack_top.next = 0;
-    ui_state.parent_stack.top = &ui_state.parent_nil_stack_top;
+
+    char *ui_memory = malloc(1 << 20);
+    UI_InitArenas((Arena) {ui_memory, ui_memory + (512 << 10)},
+                  (Arena) {ui_memory + (512 << 10), ui_memory + (1 << 20)});
+    ui_state.font = GetFontDefault();
+    UI_InitGlobals();
 
     while (!WindowShouldClose())
     {
-        UI_BeginBuild(480, 270, 1.0 / 60.0f);
+        UI_BeginBuild(480, 270, GetFrameTime());
 
-        UI_Box *panel = UI_Panel(30, 30, 200, 200, "The Panel");
+        UI_Box *panel = UI_Panel(30, 30, 200, 200, S("The Panel"));
         UI_Parent(panel)
         {
             if (UI_Button(S("Click me!")))
@@ -544,12 +1009,15 @@ int main(void)
             }
         }
 
-        UI_Solve(panel);
-        
+        UI_EndBuild();
+
         BeginDrawing();
         ClearBackground(RAYWHITE);
         UI_Render();
         EndDrawing();
     }
+
+    CloseWindow();
+    free(ui_memory);
 }
 #endif